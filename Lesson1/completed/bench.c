@@ -0,0 +1,896 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <math.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "index.h"
+#include "sort.h"
+#include "store.h"
+#include "query.h"
+#include "table.h"
+
+#define DEFAULT_SIZE_MB 100
+#define DEFAULT_VOCABULARY 50000
+#define DEFAULT_SKEW 1.0
+#define DEFAULT_PROPER_PERCENT 5
+#define DEFAULT_NUMBER_PERCENT 3
+#define DEFAULT_STOP_WORDS 50
+#define BENCH_TOP_K 100
+#define LINEAR_SAMPLE_BYTES (1 << 18)
+#define WORDS_PER_LINE 12
+#define MAX_BENCH_THREADS 32
+#define QUERY_COUNT 1000000
+#define PHRASE_QUERY_COUNT 10000
+#define AND_LONG_ROWS 4000000
+#define AND_UNIVERSE 16000000
+#define BENCH_INDEX_PATH "bench.idx"
+#define BENCH_TEXT_PATH "bench.txt"
+#define BENCH_STOP_PATH "bench-stop.txt"
+#define BENCH_SEGMENT_DIR "bench-segments"
+#define BENCH_PART_PATH "bench-part.txt"
+#define BENCH_MERGED_PATH "bench-merged.idx"
+#define SEGMENT_APPENDS 32
+#define SEGMENT_QUERY_COUNT 20000
+#define RANK_QUERY_COUNT 500
+#define RANK_TOP_K 10
+#define FUZZY_QUERY_COUNT 200
+
+/* Corpus settings, from the command line. */
+double zipfSkew = DEFAULT_SKEW;
+int properPercent = DEFAULT_PROPER_PERCENT;
+int numberPercent = DEFAULT_NUMBER_PERCENT;
+
+/* Every malloc, calloc and realloc made by the indexer code. The bench is
+ * linked with -Wl,--wrap for the three so they come through here first;
+ * allocations made inside libc itself are not seen. */
+long allocationCount;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_realloc(pointer, size);
+}
+
+unsigned long long rngState = 88172645463325252ULL;
+
+unsigned long long nextRandom()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char **makeVocabulary(int size)
+{
+    char **vocabulary = malloc(size * sizeof(char *));
+    for (int i = 0; i < size; i++)
+    {
+        int len = 3 + nextRandom() % 10;
+        vocabulary[i] = malloc(len + 1);
+        for (int k = 0; k < len; k++)
+            vocabulary[i][k] = 'a' + nextRandom() % 26;
+        vocabulary[i][len] = '\0';
+    }
+    return vocabulary;
+}
+
+/* Cumulative probabilities of a Zipf law over size ranks: rank r, from 0,
+ * has weight 1 / (r + 1)^skew, so a skew of 0 makes all ranks equal. */
+double *makeZipfTable(int size, double skew)
+{
+    double *cumulative = malloc(size * sizeof(double));
+    double total = 0;
+    for (int r = 0; r < size; r++)
+    {
+        total += pow(r + 1, -skew);
+        cumulative[r] = total;
+    }
+    for (int r = 0; r < size; r++)
+        cumulative[r] /= total;
+    return cumulative;
+}
+
+int drawRank(double *cumulative, int size)
+{
+    double u = (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+    int low = 0, high = size - 1;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (cumulative[mid] < u)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/* Rows of WORDS_PER_LINE fields, up to size bytes. Words are drawn from
+ * vocabulary, ranked by index, with zipfSkew; numberPercent of the fields
+ * are integers or reals instead and properPercent of the words are
+ * capitalised, which makes them proper nouns unless they start a row. */
+char *makeText(char **vocabulary, int vocabularySize, long size)
+{
+    double *cumulative = makeZipfTable(vocabularySize, zipfSkew);
+    char *text = malloc(size + 1);
+    char field[64];
+    long pos = 0;
+    int column = 0;
+    while (1)
+    {
+        int len;
+        if ((int)(nextRandom() % 100) < numberPercent)
+        {
+            unsigned long long value = nextRandom();
+            if (value & 1)
+                len = sprintf(field, "%llu", value >> 44);
+            else
+                len = sprintf(field, "%llu.%llu", (value >> 44) % 1000, (value >> 8) % 100);
+        }
+        else
+        {
+            char *word = vocabulary[drawRank(cumulative, vocabularySize)];
+            len = strlen(word);
+            memcpy(field, word, len);
+            if ((int)(nextRandom() % 100) < properPercent)
+                field[0] = toupper((unsigned char)field[0]);
+        }
+        if (pos + len + 1 > size)
+            break;
+        memcpy(text + pos, field, len);
+        pos += len;
+        text[pos++] = ++column % WORDS_PER_LINE == 0 ? '\n' : ' ';
+    }
+    text[pos] = '\0';
+    free(cumulative);
+    return text;
+}
+
+/* Feeds every space/newline separated token of text[0..size) to the
+ * dictionary and returns the number of tokens. */
+long indexWithDict(Dict *dict, char *text, long size)
+{
+    long tokens = 0;
+    long start = 0;
+    for (long i = 0; i < size; i++)
+    {
+        if (text[i] == ' ' || text[i] == '\n')
+        {
+            if (i > start)
+            {
+                dictInsert(dict, text + start, i - start, NULL);
+                tokens++;
+            }
+            start = i + 1;
+        }
+    }
+    return tokens;
+}
+
+/* The lookup appendWords used to do: a strcmp against every known word. */
+long indexLinear(char **known, int *knownCount, char *text, long size)
+{
+    long tokens = 0;
+    long start = 0;
+    char word[64];
+    for (long i = 0; i < size; i++)
+    {
+        if (text[i] == ' ' || text[i] == '\n')
+        {
+            int len = i - start;
+            if (len > 0 && len < (int)sizeof(word))
+            {
+                memcpy(word, text + start, len);
+                word[len] = '\0';
+                int j;
+                for (j = 0; j < *knownCount; j++)
+                    if (strcmp(known[j], word) == 0)
+                        break;
+                if (j == *knownCount)
+                    known[(*knownCount)++] = strdup(word);
+                tokens++;
+            }
+            start = i + 1;
+        }
+    }
+    return tokens;
+}
+
+/* Compares the varint posting encoding with the raw 8-byte postings:
+ * bytes used, and the time to walk every list in each form. */
+void benchPostingCompression(Index *index)
+{
+    long count = 0, encodedSize = 0;
+    int maxLength = 0;
+    for (int i = 0; i < index->dict.count; i++)
+    {
+        PostingList *list = &index->postings[i];
+        count += list->length;
+        encodedSize += encodedPostingsSize(list->items, list->length);
+        if (list->length > maxLength)
+            maxLength = list->length;
+    }
+    unsigned char *encoded = malloc(encodedSize);
+    unsigned char *out = encoded;
+    for (int i = 0; i < index->dict.count; i++)
+        out += encodePostings(index->postings[i].items, index->postings[i].length, out);
+
+    unsigned long long checksum = 0;
+    double start = now();
+    for (int i = 0; i < index->dict.count; i++)
+        for (int j = 0; j < index->postings[i].length; j++)
+            checksum += index->postings[i].items[j];
+    double rawTime = now() - start;
+
+    Posting *decoded = malloc(maxLength * sizeof(Posting));
+    const unsigned char *in = encoded;
+    start = now();
+    for (int i = 0; i < index->dict.count; i++)
+    {
+        int length = index->postings[i].length;
+        in = decodePostings(in, decoded, length);
+        for (int j = 0; j < length; j++)
+            checksum -= decoded[j];
+    }
+    double decodeTime = now() - start;
+
+    printf("postings: %ld, raw %.1f MB, varint %.1f MB (%.2f bytes/posting, %.1fx smaller)\n",
+           count, count * sizeof(Posting) / 1048576.0, encodedSize / 1048576.0,
+           (double)encodedSize / count, (double)count * sizeof(Posting) / encodedSize);
+    printf("posting scan: raw %.1f Mpostings/s, varint decode %.1f Mpostings/s%s\n",
+           count / 1e6 / rawTime, count / 1e6 / decodeTime, checksum == 0 ? "" : " (MISMATCH)");
+    free(decoded);
+    free(encoded);
+}
+
+/* Times two word phrase and NEAR/5 queries between random vocabulary
+ * words, whose position lists are decoded for every query. */
+void benchPhraseQueries(StoredIndex *stored, char **vocabulary, int vocabularySize)
+{
+    Dict stopWords;
+    initDict(&stopWords);
+    const char *forms[] = {"%s %s", "%s NEAR/5 %s"};
+    const char *names[] = {"phrase", "near/5"};
+    for (int f = 0; f < 2; f++)
+    {
+        long matches = 0;
+        char query[64];
+        double start = now();
+        for (int q = 0; q < PHRASE_QUERY_COUNT; q++)
+        {
+            snprintf(query, sizeof(query), forms[f], vocabulary[nextRandom() % vocabularySize],
+                     vocabulary[nextRandom() % vocabularySize]);
+            MatchList result;
+            runQuery(stored, &stopWords, query, &result);
+            matches += result.length;
+            freeMatchList(&result);
+        }
+        double elapsed = now() - start;
+        printf("%s queries: %d queries, %ld matches, %.1f us/query\n",
+               names[f], PHRASE_QUERY_COUNT, matches, elapsed * 1e6 / PHRASE_QUERY_COUNT);
+    }
+    freeDict(&stopWords);
+}
+
+/* Times prefix lookups in the automaton with the first one to three
+ * bytes of random vocabulary words, and compares its size with the keys
+ * it replaces: the key bytes plus a pointer to each. */
+void benchPrefixLookups(StoredIndex *stored, char **vocabulary, int vocabularySize)
+{
+    unsigned long long keyBytes = stored->header->namesOffset - stored->header->keysOffset;
+    printf("automaton: %llu bytes for %u keys, keys take %llu bytes + %llu for pointers\n",
+           stored->fst.size, stored->header->wordCount, keyBytes,
+           (unsigned long long)stored->header->wordCount * sizeof(char *));
+    for (int len = 1; len <= 3; len++)
+    {
+        long completions = 0;
+        int first;
+        double start = now();
+        for (int q = 0; q < QUERY_COUNT; q++)
+        {
+            char *word = vocabulary[nextRandom() % vocabularySize];
+            int wordLength = strlen(word);
+            completions += findPrefix(stored, word, wordLength < len ? wordLength : len, &first);
+        }
+        double elapsed = now() - start;
+        printf("prefix lookup, %d byte prefix: %d queries, %.1f completions/query, %.3f us/query\n",
+               len, QUERY_COUNT, (double)completions / QUERY_COUNT, elapsed * 1e6 / QUERY_COUNT);
+    }
+}
+
+/* Edit distance of two byte strings, capped at limit + 1: the full
+ * table, as a scan of the dictionary without an automaton computes it. */
+int editDistance(const char *a, int aLength, const char *b, int bLength, int limit)
+{
+    int row[MAX_WORD_LENGTH + 1], next[MAX_WORD_LENGTH + 1];
+    if (aLength > MAX_WORD_LENGTH || bLength > MAX_WORD_LENGTH)
+        return limit + 1;
+    for (int j = 0; j <= bLength; j++)
+        row[j] = j;
+    for (int i = 1; i <= aLength; i++)
+    {
+        next[0] = i;
+        for (int j = 1; j <= bLength; j++)
+        {
+            int best = row[j - 1] + (a[i - 1] != b[j - 1]);
+            if (row[j] + 1 < best)
+                best = row[j] + 1;
+            if (next[j - 1] + 1 < best)
+                best = next[j - 1] + 1;
+            next[j] = best;
+        }
+        memcpy(row, next, (bLength + 1) * sizeof(int));
+    }
+    return row[bLength] > limit ? limit + 1 : row[bLength];
+}
+
+/* Fuzzy lookups of vocabulary words with one random edit, through the
+ * Levenshtein automaton walked along the key automaton and through a
+ * scan computing the distance to every key, which must agree. */
+void benchFuzzyLookups(StoredIndex *stored, char **vocabulary, int vocabularySize)
+{
+    char (*words)[MAX_WORD_LENGTH + 2] = malloc(FUZZY_QUERY_COUNT * sizeof(*words));
+    for (int q = 0; q < FUZZY_QUERY_COUNT; q++)
+    {
+        char *word = vocabulary[nextRandom() % vocabularySize];
+        int len = strlen(word), at = nextRandom() % len, edit = nextRandom() % 3;
+        memcpy(words[q], word, at);
+        int out = at;
+        if (edit != 2)
+            words[q][out++] = 'a' + nextRandom() % 26;
+        int rest = edit == 1 ? at : at + 1;
+        memcpy(words[q] + out, word + rest, len - rest);
+        words[q][out + len - rest] = '\0';
+    }
+    for (int distance = 1; distance <= MAX_FUZZY_DISTANCE; distance++)
+    {
+        long found = 0, scanned = 0;
+        int mismatches = 0;
+        double automatonTime = 0, scanTime = 0;
+        for (int q = 0; q < FUZZY_QUERY_COUNT; q++)
+        {
+            int len = strlen(words[q]);
+            FuzzyTerm *terms;
+            double start = now();
+            int count = findFuzzyTerms(stored, words[q], len, distance, &terms);
+            automatonTime += now() - start;
+            found += count;
+
+            int matched = 0, agree = 1;
+            start = now();
+            for (unsigned int t = 0; t < stored->header->wordCount; t++)
+            {
+                TermEntry *entry = &stored->terms[t];
+                int d = editDistance(words[q], len, stored->keys + entry->keyOffset, entry->keyLength, distance);
+                if (d > distance)
+                    continue;
+                agree &= matched < count && terms[matched].term == (int)t && terms[matched].distance == d;
+                matched++;
+            }
+            scanTime += now() - start;
+            scanned += matched;
+            mismatches += !agree || matched != count;
+            free(terms);
+        }
+        printf("fuzzy lookup, distance %d: %d queries, %.1f terms/query, automaton %.1f us/query, "
+               "scan of %u keys %.1f us/query%s\n",
+               distance, FUZZY_QUERY_COUNT, (double)found / FUZZY_QUERY_COUNT, automatonTime * 1e6 / FUZZY_QUERY_COUNT,
+               stored->header->wordCount, scanTime * 1e6 / FUZZY_QUERY_COUNT,
+               mismatches > 0 || found != scanned ? " (MISMATCH)" : "");
+    }
+    free(words);
+}
+
+/* Top-10 BM25 queries of one to five words drawn with the text's own
+ * Zipf law, so common words come up as often as they would from users,
+ * ranked once by scoring every row that has a query word and once with
+ * WAND, which must return the same rows. */
+void benchRankedQueries(char **vocabulary, int vocabularySize)
+{
+    SegmentSet set;
+    if (openSegmentSet(BENCH_INDEX_PATH, &set) == IO_ERROR)
+        return;
+    double *cumulative = makeZipfTable(vocabularySize, zipfSkew);
+    RankedRow *exhaustive = malloc(RANK_TOP_K * sizeof(RankedRow));
+    RankedRow *pruned = malloc(RANK_TOP_K * sizeof(RankedRow));
+    for (int count = 1; count <= 5; count++)
+    {
+        char *words[5];
+        long scored[2] = {0, 0};
+        double elapsed[2] = {0, 0};
+        int mismatches = 0;
+        for (int q = 0; q < RANK_QUERY_COUNT; q++)
+        {
+            for (int w = 0; w < count; w++)
+                words[w] = vocabulary[drawRank(cumulative, vocabularySize)];
+            double start = now();
+            int found = rankRows(&set, words, count, RANK_TOP_K, 1, exhaustive, &scored[0]);
+            elapsed[0] += now() - start;
+            start = now();
+            int prunedFound = rankRows(&set, words, count, RANK_TOP_K, 0, pruned, &scored[1]);
+            elapsed[1] += now() - start;
+            int same = found == prunedFound;
+            for (int i = 0; i < found && same; i++)
+                same = exhaustive[i].row == pruned[i].row;
+            mismatches += !same;
+        }
+        printf("rank %d words, top %d: exhaustive %.1f us/query %ld rows scored, wand %.1f us/query %ld rows scored "
+               "(%.1f%%)%s\n",
+               count, RANK_TOP_K, elapsed[0] * 1e6 / RANK_QUERY_COUNT, scored[0] / RANK_QUERY_COUNT,
+               elapsed[1] * 1e6 / RANK_QUERY_COUNT, scored[1] / RANK_QUERY_COUNT,
+               scored[0] > 0 ? 100.0 * scored[1] / scored[0] : 0.0, mismatches == 0 ? "" : " (MISMATCH)");
+    }
+    free(exhaustive);
+    free(pruned);
+    free(cumulative);
+    closeSegmentSet(&set);
+}
+
+/* About count distinct rows of 1..universe, picked at random, in order. */
+Posting *makeRowList(int count, int universe, int *length)
+{
+    Posting *rows = malloc((count + count / 8 + 16) * sizeof(Posting));
+    *length = 0;
+    unsigned long long threshold = (unsigned long long)(((double)count / universe) * 4294967296.0);
+    for (int row = 1; row <= universe && *length < count + count / 8 + 16; row++)
+        if ((nextRandom() & 0xffffffffu) < threshold)
+            rows[(*length)++] = makePosting(row, 1);
+    return rows;
+}
+
+/* The rows of a row list as a row set. */
+RowSet *makeRowSet(Posting *rows, int length)
+{
+    RowSet *set = malloc(sizeof(RowSet));
+    initRowSet(set);
+    for (int i = 0; i < length; i++)
+        addRow(set, postingRow(rows[i]));
+    return set;
+}
+
+/* Intersects a long row list with shorter ones of decreasing size, once
+ * merging only, once galloping only and once choosing per list as
+ * makeAndCursor does with GALLOP_RATIO, and then the same rows as row
+ * sets, whose size is compared with that of the lists. */
+void benchIntersection()
+{
+    int longLength;
+    Posting *longRows = makeRowList(AND_LONG_ROWS, AND_UNIVERSE, &longLength);
+    RowSet *longSet = makeRowSet(longRows, longLength);
+    const char *names[] = {"merge", "gallop", "adaptive"};
+    int ratios[] = {INT_MAX, 0, GALLOP_RATIO};
+    for (int skew = 1; skew <= 4096; skew *= 4)
+    {
+        int shortLength;
+        Posting *shortRows = makeRowList(AND_LONG_ROWS / skew, AND_UNIVERSE, &shortLength);
+        RowSet *shortSet = makeRowSet(shortRows, shortLength);
+        printf("AND %d x %d rows:", longLength, shortLength);
+        long rows = 0;
+        for (int m = 0; m < 3; m++)
+        {
+            RowCursor *children[2];
+            children[0] = makeTermCursor(malloc(longLength * sizeof(Posting)), longLength);
+            memcpy(children[0]->postings, longRows, longLength * sizeof(Posting));
+            children[1] = makeTermCursor(malloc(shortLength * sizeof(Posting)), shortLength);
+            memcpy(children[1]->postings, shortRows, shortLength * sizeof(Posting));
+            RowCursor *cursor = makeAndCursor(children, 2, ratios[m]);
+            rows = 0;
+            double start = now();
+            while (nextRow(cursor) != ROW_END)
+                rows++;
+            double elapsed = now() - start;
+            printf(" %s %.2f ms", names[m], elapsed * 1e3);
+            if (m == 2)
+                printf(" (%ld rows)", rows);
+            freeRowCursor(cursor);
+        }
+        RowSet both;
+        initRowSet(&both);
+        double start = now();
+        intersectRowSets(longSet, shortSet, &both);
+        int container = 0, position = 0;
+        unsigned int row = 0;
+        long walked = 0;
+        while (seekRowSet(&both, &container, &position, row + 1, &row))
+            walked++;
+        double elapsed = now() - start;
+        printf(" row sets %.2f ms%s, %.1f vs %.1f bytes/row\n", elapsed * 1e3,
+               walked != rows ? " (MISMATCH)" : "", (double)rowSetBytes(shortSet) / shortLength,
+               (double)sizeof(Posting));
+        freeRowSet(&both);
+        freeRowSet(shortSet);
+        free(shortSet);
+        free(shortRows);
+    }
+    printf("row set of %d rows in %d: %ld bytes, as a row list %ld bytes\n", longLength, AND_UNIVERSE,
+           rowSetBytes(longSet), (long)longLength * sizeof(Posting));
+    freeRowSet(longSet);
+    free(longSet);
+    free(longRows);
+}
+
+/* The mean time printQuery takes to answer a random vocabulary word
+ * from the index at path, its output thrown away. */
+double segmentQueryTime(char *path, char **vocabulary, int vocabularySize)
+{
+    SegmentSet set;
+    if (openSegmentSet(path, &set) == IO_ERROR)
+        return 0;
+    Dict noStopWords;
+    initDict(&noStopWords);
+    FILE *null = fopen("/dev/null", "w");
+    OutputWriter *out = malloc(sizeof(OutputWriter));
+    initOutput(out, null);
+    double start = now();
+    for (int q = 0; q < SEGMENT_QUERY_COUNT; q++)
+        printQuery(out, &set, &noStopWords, vocabulary[nextRandom() % vocabularySize]);
+    flushOutput(out);
+    double elapsed = now() - start;
+    free(out);
+    fclose(null);
+    freeDict(&noStopWords);
+    closeSegmentSet(&set);
+    return elapsed * 1e6 / SEGMENT_QUERY_COUNT;
+}
+
+void removeSegmentDirectory(char *dir)
+{
+    Manifest manifest;
+    char path[256];
+    if (readManifest(dir, &manifest) == IO_SUCCESS)
+    {
+        for (int s = 0; s < manifest.count; s++)
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, manifest.segments[s].name);
+            remove(path);
+        }
+        freeManifest(&manifest);
+    }
+    const char *names[] = {SEGMENT_MANIFEST, SEGMENT_LOCK, SEGMENT_MERGE_LOCK};
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        remove(path);
+    }
+    rmdir(dir);
+}
+
+/* Feeds the text to a segment directory in SEGMENT_APPENDS slices, once
+ * leaving the segments as they come and once running the tiered merge
+ * policy after every append, as a server does in the background, and
+ * compares the bytes written and the query latency with those of the
+ * whole text merged into one file. */
+void benchSegments(char *text, long size, char **vocabulary, int vocabularySize)
+{
+    Dict noStopWords;
+    initDict(&noStopWords);
+    char *paths[] = {BENCH_PART_PATH};
+    for (int merging = 0; merging <= 1; merging++)
+    {
+        double appendTime = 0, mergeTime = 0;
+        int maxSegments = 0;
+        long start = 0;
+        for (int a = 0; a < SEGMENT_APPENDS; a++)
+        {
+            long end = size;
+            char *newline = a + 1 < SEGMENT_APPENDS ? memchr(text + size / SEGMENT_APPENDS * (a + 1), '\n',
+                                                             size - size / SEGMENT_APPENDS * (a + 1))
+                                                    : NULL;
+            if (newline != NULL)
+                end = newline - text + 1;
+            FILE *fp = fopen(BENCH_PART_PATH, "w");
+            fwrite(text + start, 1, end - start, fp);
+            fclose(fp);
+            start = end;
+
+            double begin = now();
+            appendSegment(BENCH_SEGMENT_DIR, paths, 1, &noStopWords, threadCount, 0);
+            appendTime += now() - begin;
+            if (merging)
+            {
+                begin = now();
+                compactSegments(BENCH_SEGMENT_DIR);
+                mergeTime += now() - begin;
+            }
+            Manifest manifest;
+            if (readManifest(BENCH_SEGMENT_DIR, &manifest) == IO_SUCCESS)
+            {
+                if (manifest.count > maxSegments)
+                    maxSegments = manifest.count;
+                freeManifest(&manifest);
+            }
+        }
+
+        Manifest manifest;
+        if (readManifest(BENCH_SEGMENT_DIR, &manifest) == IO_SUCCESS)
+        {
+            printf("%s: %d appends, %d segments (at most %d), %.1f MB ingested, %.1f MB written, "
+                   "write amplification %.2f, append %.3f s, merge %.3f s, term query %.2f us\n",
+                   merging ? "tiered merging" : "no merging", SEGMENT_APPENDS, manifest.count, maxSegments,
+                   manifest.ingested / 1048576.0, manifest.written / 1048576.0,
+                   (double)manifest.written / manifest.ingested, appendTime, mergeTime,
+                   segmentQueryTime(BENCH_SEGMENT_DIR, vocabulary, vocabularySize));
+            if (!merging)
+            {
+                char **segmentPaths = malloc(manifest.count * sizeof(char *));
+                for (int s = 0; s < manifest.count; s++)
+                {
+                    segmentPaths[s] = malloc(strlen(BENCH_SEGMENT_DIR) + strlen(manifest.segments[s].name) + 2);
+                    sprintf(segmentPaths[s], "%s/%s", BENCH_SEGMENT_DIR, manifest.segments[s].name);
+                }
+                double begin = now();
+                mergeSegmentFiles(segmentPaths, manifest.count, BENCH_MERGED_PATH);
+                double elapsed = now() - begin;
+                printf("one segment: %d merged in %.3f s, term query %.2f us\n", manifest.count, elapsed,
+                       segmentQueryTime(BENCH_MERGED_PATH, vocabulary, vocabularySize));
+                remove(BENCH_MERGED_PATH);
+                for (int s = 0; s < manifest.count; s++)
+                    free(segmentPaths[s]);
+                free(segmentPaths);
+            }
+            freeManifest(&manifest);
+        }
+        removeSegmentDirectory(BENCH_SEGMENT_DIR);
+    }
+    remove(BENCH_PART_PATH);
+    freeDict(&noStopWords);
+}
+
+double phaseStart;
+long phaseAllocations;
+
+void startPhase()
+{
+    phaseAllocations = allocationCount;
+    phaseStart = now();
+}
+
+/* Reports the phase started last, which read size bytes. Peak RSS is
+ * the process high-water mark so far, generated text included. */
+void endPhase(const char *name, long size)
+{
+    double elapsed = now() - phaseStart;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%-16s %7.3f s %8.1f MB/s %10ld allocations, peak RSS %ld MB\n", name, elapsed,
+           size / 1048576.0 / elapsed, allocationCount - phaseAllocations, usage.ru_maxrss / 1024);
+}
+
+/* Counts the corpus again with a space-saving sketch and reports how many
+ * of the exact top words, in top[0..topCount), it also ranks top. */
+void benchSketch(int *top, int topCount, long size)
+{
+    SpaceSaving sketch;
+    initSpaceSaving(&sketch, BENCH_TOP_K * SKETCH_FACTOR);
+    startPhase();
+    sketchTable(&sketch);
+    endPhase("sketchTable", size);
+
+    int *sketchTop = malloc(BENCH_TOP_K * sizeof(int));
+    int sketchCount = topSketchWords(&sketch, BENCH_TOP_K, sketchTop);
+    int found = 0;
+    long maxError = 0;
+    for (int i = 0; i < sketchCount; i++)
+    {
+        SketchCounter *counter = &sketch.counters[sketchTop[i]];
+        int id = dictFind(&table.dict, counter->key, counter->length);
+        for (int j = 0; j < topCount; j++)
+            found += top[j] == id;
+        if (counter->error > maxError)
+            maxError = counter->error;
+    }
+    printf("top %d: sketch of %d counters finds %d, max error %ld of %ld words\n", topCount,
+           sketch.capacity, found, maxError, sketch.total);
+    free(sketchTop);
+    freeSpaceSaving(&sketch);
+}
+
+/* Runs the indexer's own phases, as main does, on the text written out
+ * as a file and a stop list of the stopCount most frequent words. */
+void benchPhases(char *text, long size, char **vocabulary, int stopCount)
+{
+    FILE *fp = fopen(BENCH_TEXT_PATH, "w");
+    fwrite(text, 1, size, fp);
+    fclose(fp);
+    fp = fopen(BENCH_STOP_PATH, "w");
+    for (int i = 0; i < stopCount; i++)
+        fprintf(fp, "%s\n", vocabulary[i]);
+    long stopSize = ftell(fp);
+    fclose(fp);
+
+    char *paths[] = {BENCH_TEXT_PATH};
+    documentPaths = paths;
+    documentCount = 1;
+
+    startPhase();
+    readFileStopWord(BENCH_STOP_PATH);
+    endPhase("readFileStopWord", stopSize);
+    startPhase();
+    buildTable();
+    endPhase("buildTable", size);
+    startPhase();
+    int *top = malloc(BENCH_TOP_K * sizeof(int));
+    int topCount = topWords(&table, BENCH_TOP_K, top);
+    endPhase("topWords", size);
+    benchSketch(top, topCount, size);
+    free(top);
+    startPhase();
+    sortTable();
+    endPhase("sortTable", size);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    startPhase();
+    printTable();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    endPhase("printTable", size);
+
+    printf("table: %d words, %d rows\n", table.dict.count, table.rowCount);
+    freeIndex(&table);
+    free(order);
+    freeDict(&stopWords);
+    remove(BENCH_TEXT_PATH);
+    remove(BENCH_STOP_PATH);
+}
+
+int main(int argc, char *argv[])
+{
+    long sizeMB = DEFAULT_SIZE_MB;
+    int vocabularySize = DEFAULT_VOCABULARY;
+    int stopCount = DEFAULT_STOP_WORDS;
+    threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    initOutput(&output, stdout);
+    int opt;
+    while ((opt = getopt(argc, argv, "m:v:z:p:n:s:j:")) != -1)
+    {
+        if (opt == 'm')
+            sizeMB = atol(optarg);
+        else if (opt == 'v')
+            vocabularySize = atoi(optarg);
+        else if (opt == 'z')
+            zipfSkew = atof(optarg);
+        else if (opt == 'p')
+            properPercent = atoi(optarg);
+        else if (opt == 'n')
+            numberPercent = atoi(optarg);
+        else if (opt == 's')
+            stopCount = atoi(optarg);
+        else if (opt == 'j')
+            threadCount = atoi(optarg);
+        else
+        {
+            printf("Usage: %s [-m MB] [-v vocabulary] [-z zipf skew] [-p proper noun %%] [-n number %%]\n"
+                   "       [-s stop words] [-j threads]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+    if (stopCount > vocabularySize)
+        stopCount = vocabularySize;
+    long size = sizeMB * 1024 * 1024;
+
+    char **vocabulary = makeVocabulary(vocabularySize);
+    char *text = makeText(vocabulary, vocabularySize, size);
+    size = strlen(text);
+    printf("Synthetic text: %.1f MB, vocabulary %d, zipf skew %.2f, %d%% proper nouns, %d%% numbers\n",
+           size / 1048576.0, vocabularySize, zipfSkew, properPercent, numberPercent);
+    benchPhases(text, size, vocabulary, stopCount);
+
+    Dict dict;
+    initDict(&dict);
+    double start = now();
+    long tokens = indexWithDict(&dict, text, size);
+    double elapsed = now() - start;
+    printf("hash dictionary: %ld tokens, %d words, %.3f s, %.1f MB/s, %.1f Mtokens/s\n",
+           tokens, dict.count, elapsed, size / 1048576.0 / elapsed, tokens / 1e6 / elapsed);
+    /* proper nouns and numbers make more distinct words than the
+     * vocabulary, and the sample holds no more than the whole text */
+    int wordCount = dict.count;
+    freeDict(&dict);
+
+    long sample = size < LINEAR_SAMPLE_BYTES ? size : LINEAR_SAMPLE_BYTES;
+    char **known = malloc(wordCount * sizeof(char *));
+    int knownCount = 0;
+    start = now();
+    tokens = indexLinear(known, &knownCount, text, sample);
+    elapsed = now() - start;
+    printf("linear scan (first %.1f MB): %ld tokens, %d words, %.3f s, %.2f MB/s\n",
+           sample / 1048576.0, tokens, knownCount, elapsed, sample / 1048576.0 / elapsed);
+
+    Dict stopWords;
+    initDict(&stopWords);
+    double single = 0;
+    for (int threads = 1; threads <= MAX_BENCH_THREADS; threads *= 2)
+    {
+        Index index;
+        initIndex(&index);
+        start = now();
+        indexTextParallel(&index, &stopWords, text, size, threads);
+        elapsed = now() - start;
+        if (threads == 1)
+            single = elapsed;
+        printf("indexText %2d threads: %.3f s, %.1f MB/s, speedup %.2f\n",
+               threads, elapsed, size / 1048576.0 / elapsed, single / elapsed);
+        freeIndex(&index);
+    }
+
+    Index index;
+    initIndex(&index);
+    indexText(&index, &stopWords, text, size);
+    int *order = malloc(index.dict.count * sizeof(int));
+    for (int i = 0; i < index.dict.count; i++)
+        order[i] = i;
+    sortWordIds(order, index.dict.count, index.dict.keys);
+    writeIndexFile(BENCH_INDEX_PATH, &index, order);
+    free(order);
+    benchPostingCompression(&index);
+    freeIndex(&index);
+    freeDict(&stopWords);
+
+    StoredIndex stored;
+    if (openIndexFile(BENCH_INDEX_PATH, &stored) == IO_SUCCESS)
+    {
+        long found = 0;
+        start = now();
+        for (int q = 0; q < QUERY_COUNT; q++)
+        {
+            char *word = vocabulary[nextRandom() % vocabularySize];
+            found += findTerm(&stored, word, strlen(word)) >= 0;
+        }
+        elapsed = now() - start;
+        printf("stored index lookup: %d queries, %ld found, %.3f us/query\n",
+               QUERY_COUNT, found, elapsed * 1e6 / QUERY_COUNT);
+        benchPrefixLookups(&stored, vocabulary, vocabularySize);
+        benchFuzzyLookups(&stored, vocabulary, vocabularySize);
+        benchPhraseQueries(&stored, vocabulary, vocabularySize);
+        closeIndexFile(&stored);
+        benchRankedQueries(vocabulary, vocabularySize);
+    }
+    remove(BENCH_INDEX_PATH);
+    benchIntersection();
+    benchSegments(text, size, vocabulary, vocabularySize);
+
+    for (int i = 0; i < knownCount; i++)
+        free(known[i]);
+    free(known);
+    for (int i = 0; i < vocabularySize; i++)
+        free(vocabulary[i]);
+    free(vocabulary);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+
+unsigned int hashWord(const char *key, int len)
+{
+    /* FNV-1a */
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *arenaCopy(Dict *dict, const char *key, int len)
+{
+    ArenaBlock *block = dict->arena;
+    if (block == NULL || block->used + len + 1 > block->size)
+    {
+        int size = len + 1 > ARENA_BLOCK_SIZE ? len + 1 : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + size);
+        block->next = dict->arena;
+        block->used = 0;
+        block->size = size;
+        dict->arena = block;
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+    return copy;
+}
+
+void initDict(Dict *dict)
+{
+    dict->capacity = DICT_INIT_CAPACITY;
+    dict->slots = calloc(dict->capacity, sizeof(DictSlot));
+    dict->count = 0;
+    dict->keyCapacity = DICT_INIT_CAPACITY / 2;
+    dict->keys = malloc(dict->keyCapacity * sizeof(char *));
+    dict->lengths = malloc(dict->keyCapacity * sizeof(int));
+    dict->arena = NULL;
+}
+
+void freeDict(Dict *dict)
+{
+    ArenaBlock *block = dict->arena;
+    while (block != NULL)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(dict->slots);
+    free(dict->keys);
+    free(dict->lengths);
+    dict->slots = NULL;
+    dict->keys = NULL;
+    dict->lengths = NULL;
+    dict->arena = NULL;
+    dict->count = 0;
+}
+
+static void growSlots(Dict *dict)
+{
+    int capacity = dict->capacity * 2;
+    DictSlot *slots = calloc(capacity, sizeof(DictSlot));
+    unsigned int mask = capacity - 1;
+    for (int i = 0; i < dict->capacity; i++)
+    {
+        if (dict->slots[i].id == 0)
+            continue;
+        unsigned int pos = dict->slots[i].hash & mask;
+        while (slots[pos].id != 0)
+            pos = (pos + 1) & mask;
+        slots[pos] = dict->slots[i];
+    }
+    free(dict->slots);
+    dict->slots = slots;
+    dict->capacity = capacity;
+}
+
+/* Returns the slot holding key, or the empty slot where it belongs. */
+static DictSlot *probe(Dict *dict, const char *key, int len, unsigned int hash)
+{
+    unsigned int mask = dict->capacity - 1;
+    unsigned int pos = hash & mask;
+    while (1)
+    {
+        DictSlot *slot = &dict->slots[pos];
+        if (slot->id == 0)
+            return slot;
+        if (slot->hash == hash)
+        {
+            int id = slot->id - 1;
+            if (dict->lengths[id] == len && memcmp(dict->keys[id], key, len) == 0)
+                return slot;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+int dictFind(Dict *dict, const char *key, int len)
+{
+    DictSlot *slot = probe(dict, key, len, hashWord(key, len));
+    return slot->id - 1;
+}
+
+int dictInsert(Dict *dict, const char *key, int len, int *isNew)
+{
+    unsigned int hash = hashWord(key, len);
+    DictSlot *slot = probe(dict, key, len, hash);
+    if (slot->id != 0)
+    {
+        if (isNew != NULL)
+            *isNew = 0;
+        return slot->id - 1;
+    }
+
+    if (dict->count == dict->keyCapacity)
+    {
+        dict->keyCapacity *= 2;
+        dict->keys = realloc(dict->keys, dict->keyCapacity * sizeof(char *));
+        dict->lengths = realloc(dict->lengths, dict->keyCapacity * sizeof(int));
+    }
+    int id = dict->count++;
+    dict->keys[id] = arenaCopy(dict, key, len);
+    dict->lengths[id] = len;
+    slot->hash = hash;
+    slot->id = id + 1;
+
+    /* keep the load factor at or below 1/2 */
+    if (dict->count * 2 > dict->capacity)
+        growSlots(dict);
+
+    if (isNew != NULL)
+        *isNew = 1;
+    return id;
+}
@@ -0,0 +1,50 @@
+#ifndef __DICT_H__
+#define __DICT_H__
+
+#define DICT_INIT_CAPACITY 1024
+#define ARENA_BLOCK_SIZE 65536
+
+/* Key bytes live in a chain of large blocks so inserting a word never
+ * costs a malloc of its own and keys stay close together in memory. */
+struct ArenaBlock_
+{
+    struct ArenaBlock_ *next;
+    int used;
+    int size;
+    char data[];
+};
+
+typedef struct ArenaBlock_ ArenaBlock;
+
+struct DictSlot_
+{
+    unsigned int hash;
+    int id; /* word id + 1, 0 marks an empty slot */
+};
+
+typedef struct DictSlot_ DictSlot;
+
+/* Open-addressing (linear probing) map from word to a dense id.
+ * Ids are handed out in insertion order starting from 0. */
+struct Dict_
+{
+    DictSlot *slots;
+    int capacity; /* power of two */
+    int count;
+    char **keys;
+    int *lengths;
+    int keyCapacity;
+    ArenaBlock *arena;
+};
+
+typedef struct Dict_ Dict;
+
+unsigned int hashWord(const char *key, int len);
+
+void initDict(Dict *dict);
+void freeDict(Dict *dict);
+
+int dictFind(Dict *dict, const char *key, int len);
+int dictInsert(Dict *dict, const char *key, int len, int *isNew);
+
+#endif
@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fst.h"
+#include "dict.h"
+#include "posting.h"
+
+#define FST_INIT_SLOTS 1024
+
+void initFstBuilder(FstBuilder *builder)
+{
+    memset(builder, 0, sizeof(FstBuilder));
+    builder->slotCapacity = FST_INIT_SLOTS;
+    builder->slots = calloc(builder->slotCapacity, sizeof(FstSlot));
+    builder->pathCapacity = 1;
+    builder->path = calloc(1, sizeof(FstPending));
+}
+
+void freeFstBuilder(FstBuilder *builder)
+{
+    for (int d = 0; d < builder->pathCapacity; d++)
+        free(builder->path[d].arcs);
+    free(builder->path);
+    free(builder->bytes);
+    free(builder->previous);
+    free(builder->slots);
+    free(builder->scratch);
+    memset(builder, 0, sizeof(FstBuilder));
+}
+
+static void growSlots(FstBuilder *builder)
+{
+    FstSlot *old = builder->slots;
+    int oldCapacity = builder->slotCapacity;
+    builder->slotCapacity *= 2;
+    builder->slots = calloc(builder->slotCapacity, sizeof(FstSlot));
+    int mask = builder->slotCapacity - 1;
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].offset == 0)
+            continue;
+        int j = old[i].hash & mask;
+        while (builder->slots[j].offset != 0)
+            j = (j + 1) & mask;
+        builder->slots[j] = old[i];
+    }
+    free(old);
+}
+
+/* Writes the state at offset in the form freezeState compares states
+ * in, with absolute targets, and returns its length. */
+static int canonicalState(const unsigned char *bytes, unsigned long long offset, unsigned char *out)
+{
+    unsigned char *start = out;
+    unsigned long long header, value;
+    const unsigned char *p = getLongVarint(bytes + offset, &header);
+    out = putLongVarint(out, header);
+    for (unsigned long long a = 0; a < header >> 1; a++)
+    {
+        *out++ = *p++;
+        if (a > 0)
+        {
+            p = getLongVarint(p, &value);
+            out = putLongVarint(out, value);
+        }
+        p = getLongVarint(p, &value);
+        out = putLongVarint(out, offset - value);
+    }
+    return out - start;
+}
+
+/* Returns the offset of a frozen state equal to the one in canonical
+ * form in scratch, appending it if there is none yet. */
+static unsigned long long registerState(FstBuilder *builder, int length)
+{
+    unsigned char *canonical = builder->scratch;
+    unsigned char *other = builder->scratch + builder->scratchCapacity / 2;
+    unsigned int hash = hashWord((const char *)canonical, length);
+    int mask = builder->slotCapacity - 1;
+    int i = hash & mask;
+    for (; builder->slots[i].offset != 0; i = (i + 1) & mask)
+    {
+        FstSlot *slot = &builder->slots[i];
+        if (slot->hash == hash && slot->length == (unsigned int)length &&
+            canonicalState(builder->bytes, slot->offset - 1, other) == length &&
+            memcmp(other, canonical, length) == 0)
+            return slot->offset - 1;
+    }
+
+    /* a distance back can take more bytes than the target it replaces */
+    unsigned long long header, value;
+    const unsigned char *p = getLongVarint(canonical, &header);
+    unsigned long long needed = length + (header >> 1) * 9;
+    if (builder->size + needed > builder->capacity)
+    {
+        builder->capacity = builder->capacity == 0 ? 4096 : builder->capacity * 2;
+        while (builder->capacity < builder->size + needed)
+            builder->capacity *= 2;
+        builder->bytes = realloc(builder->bytes, builder->capacity);
+    }
+    unsigned long long offset = builder->size;
+    unsigned char *out = putLongVarint(builder->bytes + offset, header);
+    for (unsigned long long a = 0; a < header >> 1; a++)
+    {
+        *out++ = *p++;
+        if (a > 0)
+        {
+            p = getLongVarint(p, &value);
+            out = putLongVarint(out, value);
+        }
+        p = getLongVarint(p, &value);
+        out = putLongVarint(out, offset - value);
+    }
+    builder->size = out - builder->bytes;
+
+    builder->slots[i].offset = offset + 1;
+    builder->slots[i].hash = hash;
+    builder->slots[i].length = length;
+    if (++builder->slotCount * 2 > builder->slotCapacity)
+        growSlots(builder);
+    return offset;
+}
+
+/* Puts the state open at depth, whose arcs all lead to frozen states by
+ * now, in the automaton and empties it. Returns its offset and stores
+ * how many keys it accepts in count. */
+static unsigned long long freezeState(FstBuilder *builder, int depth, unsigned int *count)
+{
+    FstPending *state = &builder->path[depth];
+    int needed = 2 * (10 + state->arcCount * 21);
+    if (needed > builder->scratchCapacity)
+    {
+        builder->scratchCapacity = needed;
+        builder->scratch = realloc(builder->scratch, needed);
+    }
+
+    unsigned char *out = builder->scratch;
+    out = putLongVarint(out, (unsigned long long)state->arcCount << 1 | state->final);
+    unsigned int before = state->final;
+    for (int a = 0; a < state->arcCount; a++)
+    {
+        *out++ = state->arcs[a].label;
+        if (a > 0)
+            out = putLongVarint(out, before);
+        out = putLongVarint(out, state->arcs[a].target);
+        before += state->arcs[a].count;
+    }
+    state->arcCount = 0;
+    state->final = 0;
+    *count = before;
+    return registerState(builder, out - builder->scratch);
+}
+
+/* Freezes the open states deeper than depth, leaving depth open. */
+static void freezeBelow(FstBuilder *builder, int depth)
+{
+    for (int d = builder->previousLength; d > depth; d--)
+    {
+        FstPending *parent = &builder->path[d - 1];
+        FstArc *arc = &parent->arcs[parent->arcCount - 1];
+        arc->target = freezeState(builder, d, &arc->count);
+    }
+}
+
+void fstAdd(FstBuilder *builder, const char *key, int len)
+{
+    int common = 0;
+    while (common < len && common < builder->previousLength && key[common] == builder->previous[common])
+        common++;
+    freezeBelow(builder, common);
+
+    if (len + 1 > builder->pathCapacity)
+    {
+        int capacity = builder->pathCapacity;
+        while (capacity < len + 1)
+            capacity *= 2;
+        builder->path = realloc(builder->path, capacity * sizeof(FstPending));
+        memset(builder->path + builder->pathCapacity, 0, (capacity - builder->pathCapacity) * sizeof(FstPending));
+        builder->pathCapacity = capacity;
+    }
+    for (int d = common; d < len; d++)
+    {
+        FstPending *state = &builder->path[d];
+        if (state->arcCount == state->arcCapacity)
+        {
+            state->arcCapacity = state->arcCapacity == 0 ? 4 : state->arcCapacity * 2;
+            state->arcs = realloc(state->arcs, state->arcCapacity * sizeof(FstArc));
+        }
+        FstArc *arc = &state->arcs[state->arcCount++];
+        arc->label = key[d];
+        arc->target = 0;
+        arc->count = 0;
+    }
+    builder->path[len].final = 1;
+
+    if (len + 1 > builder->previousCapacity)
+    {
+        builder->previousCapacity = len + 1;
+        builder->previous = realloc(builder->previous, builder->previousCapacity);
+    }
+    memcpy(builder->previous, key, len);
+    builder->previousLength = len;
+}
+
+/* Freezes what is still open. fst points into builder, which must be
+ * kept until fst is no longer used. */
+void finishFst(FstBuilder *builder, Fst *fst)
+{
+    unsigned int count;
+    freezeBelow(builder, 0);
+    builder->previousLength = 0;
+    fst->root = freezeState(builder, 0, &count);
+    fst->bytes = builder->bytes;
+    fst->size = builder->size;
+}
+
+/* Follows the arc labelled c out of *state, adding its output to *rank.
+ * Returns 0 if the state has no such arc. */
+static int followArc(const Fst *fst, unsigned long long *state, unsigned char c, unsigned long long *rank)
+{
+    unsigned long long header, output, delta;
+    const unsigned char *p = getLongVarint(fst->bytes + *state, &header);
+    for (unsigned long long a = 0; a < header >> 1; a++)
+    {
+        unsigned char label = *p++;
+        output = header & 1;
+        if (a > 0)
+            p = getLongVarint(p, &output);
+        p = getLongVarint(p, &delta);
+        if (label == c)
+        {
+            *rank += output;
+            *state -= delta;
+            return 1;
+        }
+        if (label > c)
+            return 0;
+    }
+    return 0;
+}
+
+/* The number of keys accepted from state: those before its last arc
+ * plus those its last arc leads to. */
+static int stateCount(const Fst *fst, unsigned long long state)
+{
+    int count = 0;
+    while (1)
+    {
+        unsigned long long header, output, delta;
+        const unsigned char *p = getLongVarint(fst->bytes + state, &header);
+        if (header >> 1 == 0)
+            return count + (header & 1);
+        for (unsigned long long a = 0; a < header >> 1; a++)
+        {
+            p++;
+            output = header & 1;
+            if (a > 0)
+                p = getLongVarint(p, &output);
+            p = getLongVarint(p, &delta);
+        }
+        count += output;
+        state -= delta;
+    }
+}
+
+/* Returns the rank of key among the keys, or -1 if it is not one. */
+int fstFind(const Fst *fst, const char *key, int len)
+{
+    unsigned long long state = fst->root, rank = 0, header;
+    for (int i = 0; i < len; i++)
+        if (!followArc(fst, &state, key[i], &rank))
+            return -1;
+    getLongVarint(fst->bytes + state, &header);
+    return header & 1 ? (int)rank : -1;
+}
+
+/* Returns how many keys start with prefix and stores the rank of the
+ * first of them in first. */
+int fstPrefix(const Fst *fst, const char *prefix, int len, int *first)
+{
+    unsigned long long state = fst->root, rank = 0;
+    for (int i = 0; i < len; i++)
+        if (!followArc(fst, &state, prefix[i], &rank))
+            return 0;
+    *first = rank;
+    return stateCount(fst, state);
+}
+
+/* Starts on the arcs of state and sets arcs->final if it accepts. */
+void fstStartArcs(const Fst *fst, unsigned long long state, FstArcs *arcs)
+{
+    unsigned long long header;
+    arcs->next = getLongVarint(fst->bytes + state, &header);
+    arcs->state = state;
+    arcs->remaining = header >> 1;
+    arcs->first = 1;
+    arcs->final = header & 1;
+}
+
+/* Reads the next arc: its label, its output, to be added to the rank of
+ * its state, and its target. Returns 0 after the last one. */
+int fstNextArc(FstArcs *arcs, unsigned char *label, unsigned long long *output, unsigned long long *target)
+{
+    unsigned long long delta;
+    if (arcs->remaining == 0)
+        return 0;
+    *label = *arcs->next++;
+    *output = arcs->final;
+    if (!arcs->first)
+        arcs->next = getLongVarint(arcs->next, output);
+    arcs->next = getLongVarint(arcs->next, &delta);
+    *target = arcs->state - delta;
+    arcs->first = 0;
+    arcs->remaining--;
+    return 1;
+}
+
+/* Returns 1 if fst is laid out as finishFst leaves an automaton over
+ * count keys: states back to back, the arcs of each in label order and
+ * leading to states before it, every output the number of keys its
+ * state accepts before the arc, and the root the last state, accepting
+ * count keys. The searches above stay within the bytes of such an
+ * automaton and only give ranks below count. */
+int fstCheck(const Fst *fst, unsigned long long count)
+{
+    /* the keys accepted from the state at each offset, 0 where none starts */
+    unsigned int *accepted = calloc(fst->size, sizeof(unsigned int));
+    const unsigned char *end = fst->bytes + fst->size;
+    unsigned long long state = 0, last = 0, before = 0;
+    int ok = 1;
+    while (ok && state < fst->size)
+    {
+        unsigned long long header, output, delta;
+        const unsigned char *p = getBoundedVarint(fst->bytes + state, end, &header);
+        ok = p != NULL && header >> 1 <= 256;
+        before = ok ? header & 1 : 0;
+        int previous = -1;
+        for (unsigned long long a = 0; ok && a < header >> 1; a++)
+        {
+            int label = p < end ? *p++ : -1;
+            output = header & 1;
+            if (label >= 0 && a > 0)
+                p = getBoundedVarint(p, end, &output);
+            if (label >= 0 && p != NULL)
+                p = getBoundedVarint(p, end, &delta);
+            ok = label > previous && p != NULL && output == before && delta >= 1 && delta <= state &&
+                 accepted[state - delta] > 0;
+            if (ok)
+            {
+                before += accepted[state - delta];
+                ok = before <= count;
+            }
+            previous = label;
+        }
+        if (ok)
+        {
+            accepted[state] = before;
+            last = state;
+            state = p - fst->bytes;
+        }
+    }
+    free(accepted);
+    return ok && fst->root == last && before == count;
+}
@@ -0,0 +1,109 @@
+#ifndef __FST_H__
+#define __FST_H__
+
+/* A minimal acyclic automaton over the sorted keys of an index: it is
+ * the trie of the keys with every set of states that accept the same
+ * suffixes stored once, so common endings are shared as well as common
+ * prefixes. Each arc carries the number of keys that sort before it in
+ * its state, which turns the automaton into a transducer from a key to
+ * its rank: the outputs along a key's path add up to its position in
+ * the sorted term table, and the keys that start with a prefix are the
+ * ranks from the sum along the prefix, as many as the state it reaches
+ * accepts.
+ *
+ * States are laid out children first, each as
+ *   varint   arc count << 1 | 1 if the state is final
+ *   arcs     label byte, varint output, varint distance back to the
+ *            target from the start of the state
+ * with the arcs in label order. The first arc has no output stored, as
+ * it is 1 for a final state and 0 otherwise. The last arc of a state
+ * usually leads to the state just before it, one or two bytes back. */
+struct Fst_
+{
+    const unsigned char *bytes;
+    unsigned long long size;
+    unsigned long long root;
+};
+
+typedef struct Fst_ Fst;
+
+/* An arc of the state being built at some depth; the last arc of each
+ * state leads to the next depth until that state is frozen. */
+struct FstArc_
+{
+    unsigned char label;
+    unsigned long long target;
+    unsigned int count; /* keys accepted from the target */
+};
+
+typedef struct FstArc_ FstArc;
+
+struct FstPending_
+{
+    FstArc *arcs;
+    int arcCount;
+    int arcCapacity;
+    int final;
+};
+
+typedef struct FstPending_ FstPending;
+
+/* A frozen state: offset + 1 (0 marks an empty slot) and the size of
+ * its form with absolute targets, in which states are compared. */
+struct FstSlot_
+{
+    unsigned long long offset;
+    unsigned int hash;
+    unsigned int length;
+};
+
+typedef struct FstSlot_ FstSlot;
+
+/* Builds an Fst from keys added in strictly increasing strcmp order
+ * (Daciuk's incremental construction): only the path of the last key is
+ * open, and a state is frozen, or replaced by an equal one frozen
+ * before, as soon as no later key can reach it. */
+struct FstBuilder_
+{
+    unsigned char *bytes;
+    unsigned long long size;
+    unsigned long long capacity;
+    FstPending *path;
+    int pathCapacity;
+    char *previous;
+    int previousLength;
+    int previousCapacity;
+    FstSlot *slots;
+    int slotCapacity;
+    int slotCount;
+    unsigned char *scratch;
+    int scratchCapacity;
+};
+
+typedef struct FstBuilder_ FstBuilder;
+
+/* A walk through the arcs of one state, in label order, for searches
+ * that follow several of them. */
+struct FstArcs_
+{
+    const unsigned char *next;
+    unsigned long long state;
+    unsigned long long remaining;
+    int first;
+    int final;
+};
+
+typedef struct FstArcs_ FstArcs;
+
+void initFstBuilder(FstBuilder *builder);
+void freeFstBuilder(FstBuilder *builder);
+void fstAdd(FstBuilder *builder, const char *key, int len);
+void finishFst(FstBuilder *builder, Fst *fst);
+
+int fstFind(const Fst *fst, const char *key, int len);
+int fstPrefix(const Fst *fst, const char *prefix, int len, int *first);
+void fstStartArcs(const Fst *fst, unsigned long long state, FstArcs *arcs);
+int fstNextArc(FstArcs *arcs, unsigned char *label, unsigned long long *output, unsigned long long *target);
+int fstCheck(const Fst *fst, unsigned long long count);
+
+#endif
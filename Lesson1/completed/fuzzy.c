@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzzy.h"
+
+/* Bytes in the UTF-8 sequence a byte starts; a byte that cannot start
+ * one stands alone. */
+static int sequenceLength(unsigned char lead)
+{
+    if (lead >= 0xc0 && lead < 0xe0)
+        return 2;
+    if (lead >= 0xe0 && lead < 0xf0)
+        return 3;
+    if (lead >= 0xf0 && lead < 0xf8)
+        return 4;
+    return 1;
+}
+
+/* Whether word, len bytes, is "w~" or "w~d" with d at most
+ * MAX_FUZZY_DISTANCE: if so stores the length of w and the distance,
+ * MAX_FUZZY_DISTANCE for "w~". */
+int parseFuzzyWord(const char *word, int len, int *wordLength, int *maxDistance)
+{
+    if (len >= 2 && word[len - 1] == FUZZY_OPERATOR)
+    {
+        *wordLength = len - 1;
+        *maxDistance = MAX_FUZZY_DISTANCE;
+        return 1;
+    }
+    if (len >= 3 && word[len - 2] == FUZZY_OPERATOR && word[len - 1] >= '0' &&
+        word[len - 1] <= '0' + MAX_FUZZY_DISTANCE)
+    {
+        *wordLength = len - 2;
+        *maxDistance = word[len - 1] - '0';
+        return 1;
+    }
+    return 0;
+}
+
+/* Code points are compared as their UTF-8 bytes packed into an int,
+ * which is all the automaton needs and treats malformed text the same
+ * way in the word and in the keys. */
+void initLevenshtein(LevenshteinAutomaton *automaton, const char *word, int len, int maxDistance)
+{
+    automaton->word = malloc((len + 1) * sizeof(unsigned int));
+    automaton->length = 0;
+    automaton->maxDistance = maxDistance;
+    const unsigned char *p = (const unsigned char *)word;
+    const unsigned char *end = p + len;
+    while (p < end)
+    {
+        int n = sequenceLength(*p);
+        unsigned int c = 0;
+        for (int i = 0; i < n && p < end; i++)
+            c = c << 8 | *p++;
+        automaton->word[automaton->length++] = c;
+    }
+}
+
+void freeLevenshtein(LevenshteinAutomaton *automaton)
+{
+    free(automaton->word);
+}
+
+/* The state before any input, in length + 1 cells. */
+void levenshteinStart(LevenshteinAutomaton *automaton, unsigned char *row)
+{
+    for (int i = 0; i <= automaton->length; i++)
+        row[i] = i <= automaton->maxDistance ? i : automaton->maxDistance + 1;
+}
+
+/* Moves from the state row, after depth code points, to next on code
+ * point c. Only the cells within maxDistance of the diagonal are
+ * written: the others of next must already hold maxDistance + 1, as
+ * they do in a row last written by a step to the same depth. Returns 0
+ * if the new state is dead. */
+int levenshteinStep(LevenshteinAutomaton *automaton, const unsigned char *row, int depth, unsigned int c,
+                    unsigned char *next)
+{
+    int d = automaton->maxDistance;
+    int to = depth + 1;
+    int low = to - d > 1 ? to - d : 1;
+    int high = to + d < automaton->length ? to + d : automaton->length;
+    int alive = 0;
+    if (to <= d)
+    {
+        next[0] = to;
+        alive = 1;
+    }
+    for (int i = low; i <= high; i++)
+    {
+        int best = row[i - 1] + (automaton->word[i - 1] != c);
+        if (row[i] + 1 < best)
+            best = row[i] + 1;
+        if (next[i - 1] + 1 < best)
+            best = next[i - 1] + 1;
+        if (best > d)
+            best = d + 1;
+        next[i] = best;
+        alive |= best <= d;
+    }
+    return alive;
+}
+
+/* A state of the search: the arcs left to follow out of an automaton
+ * state reached with rank keys before it, after depth whole code points
+ * and the first bytes of another, packed in partial, with pending more
+ * to come. */
+struct FuzzyFrame_
+{
+    FstArcs arcs;
+    unsigned long long rank;
+    int depth;
+    unsigned int partial;
+    int pending;
+};
+
+typedef struct FuzzyFrame_ FuzzyFrame;
+
+/* Adds the key ending at frame to terms if the automaton accepts it. A
+ * key cut short inside a UTF-8 sequence ends with what there is of it. */
+static void acceptKey(LevenshteinAutomaton *automaton, FuzzyFrame *frame, unsigned char *rows,
+                      unsigned char *scratch, FuzzyTerm **terms, int *count, int *capacity)
+{
+    int width = automaton->length + 1;
+    const unsigned char *row = rows + frame->depth * width;
+    if (frame->pending > 0)
+    {
+        memset(scratch, automaton->maxDistance + 1, width);
+        levenshteinStep(automaton, row, frame->depth, frame->partial, scratch);
+        row = scratch;
+    }
+    if (row[automaton->length] > automaton->maxDistance)
+        return;
+    if (*count == *capacity)
+    {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        *terms = realloc(*terms, *capacity * sizeof(FuzzyTerm));
+    }
+    (*terms)[*count].term = frame->rank;
+    (*terms)[*count].distance = row[automaton->length];
+    (*count)++;
+}
+
+/* Stores in terms, to be freed by the caller, the terms of stored within
+ * maxDistance edits of word, in term order, and returns how many there
+ * are. The automaton of word is run along the automaton of the keys
+ * depth first, and a branch is left as soon as its state is dead, so
+ * only the keys that share a prefix of a match with some close string
+ * are visited and the rest of the dictionary is never looked at. */
+int findFuzzyTerms(StoredIndex *stored, const char *word, int len, int maxDistance, FuzzyTerm **terms)
+{
+    LevenshteinAutomaton automaton;
+    initLevenshtein(&automaton, word, len, maxDistance);
+    int width = automaton.length + 1;
+    /* past length + maxDistance code points every state is dead */
+    int maxDepth = automaton.length + maxDistance + 1;
+    unsigned char *rows = malloc((maxDepth + 1) * width);
+    unsigned char *scratch = malloc(width);
+    FuzzyFrame *stack = malloc((4 * maxDepth + 1) * sizeof(FuzzyFrame));
+    memset(rows, maxDistance + 1, (maxDepth + 1) * width);
+    levenshteinStart(&automaton, rows);
+
+    *terms = NULL;
+    int count = 0, capacity = 0;
+    int top = 0;
+    memset(&stack[0], 0, sizeof(FuzzyFrame));
+    fstStartArcs(&stored->fst, stored->fst.root, &stack[0].arcs);
+    if (stack[0].arcs.final)
+        acceptKey(&automaton, &stack[0], rows, scratch, terms, &count, &capacity);
+    while (top >= 0)
+    {
+        FuzzyFrame *frame = &stack[top];
+        unsigned char label;
+        unsigned long long output, target;
+        if (!fstNextArc(&frame->arcs, &label, &output, &target))
+        {
+            top--;
+            continue;
+        }
+        FuzzyFrame *child = &stack[top + 1];
+        child->rank = frame->rank + output;
+        child->depth = frame->depth;
+        if (frame->pending == 0)
+        {
+            child->partial = label;
+            child->pending = sequenceLength(label) - 1;
+        }
+        else
+        {
+            child->partial = frame->partial << 8 | label;
+            child->pending = frame->pending - 1;
+        }
+        if (child->pending == 0)
+        {
+            const unsigned char *row = rows + child->depth * width;
+            if (!levenshteinStep(&automaton, row, child->depth, child->partial, (unsigned char *)row + width))
+                continue;
+            child->depth++;
+        }
+        fstStartArcs(&stored->fst, target, &child->arcs);
+        top++;
+        if (child->arcs.final)
+            acceptKey(&automaton, child, rows, scratch, terms, &count, &capacity);
+    }
+
+    free(stack);
+    free(scratch);
+    free(rows);
+    freeLevenshtein(&automaton);
+    return count;
+}
@@ -0,0 +1,45 @@
+#ifndef __FUZZY_H__
+#define __FUZZY_H__
+
+#include "store.h"
+
+/* "word~" matches the terms within MAX_FUZZY_DISTANCE edits of word,
+ * "word~d" those within d. */
+#define FUZZY_OPERATOR '~'
+#define MAX_FUZZY_DISTANCE 2
+
+/* The Levenshtein automaton of a word: it accepts the strings within
+ * maxDistance insertions, deletions or substitutions of a code point of
+ * it. Its state after some input is the row of the edit distance table
+ * for that input, one cell per prefix of the word, with every distance
+ * over maxDistance stored as maxDistance + 1; only the cells at most
+ * maxDistance from the diagonal can be lower, so a step computes those
+ * alone. A state with no cell within maxDistance is dead: no string that
+ * starts with its input is accepted. */
+struct LevenshteinAutomaton_
+{
+    unsigned int *word; /* code points */
+    int length;
+    int maxDistance;
+};
+
+typedef struct LevenshteinAutomaton_ LevenshteinAutomaton;
+
+/* A term of an index near the word searched for. */
+struct FuzzyTerm_
+{
+    int term;
+    int distance;
+};
+
+typedef struct FuzzyTerm_ FuzzyTerm;
+
+int parseFuzzyWord(const char *word, int len, int *wordLength, int *maxDistance);
+void initLevenshtein(LevenshteinAutomaton *automaton, const char *word, int len, int maxDistance);
+void freeLevenshtein(LevenshteinAutomaton *automaton);
+void levenshteinStart(LevenshteinAutomaton *automaton, unsigned char *row);
+int levenshteinStep(LevenshteinAutomaton *automaton, const unsigned char *row, int depth, unsigned int c,
+                    unsigned char *next);
+int findFuzzyTerms(StoredIndex *stored, const char *word, int len, int maxDistance, FuzzyTerm **terms);
+
+#endif
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "index.h"
+#include "tokenizer.h"
+#include "unicode.h"
+
+/* Texts below this size are not worth splitting across threads. */
+#define MIN_CHUNK_SIZE (1 << 20)
+
+struct IndexJob_
+{
+    Index index;
+    Dict *stopWords;
+    char *text;
+    long size;
+    pthread_t thread;
+};
+
+typedef struct IndexJob_ IndexJob;
+
+struct TextContext_
+{
+    Index *index;
+    Dict *stopWords;
+};
+
+typedef struct TextContext_ TextContext;
+
+void initIndex(Index *index)
+{
+    initDict(&index->dict);
+    index->types = NULL;
+    index->postings = NULL;
+    index->capacity = 0;
+    index->rowCount = 0;
+    index->docFirstRows = NULL;
+    index->docBytes = NULL;
+    index->docCompleteBytes = NULL;
+    index->docNames = NULL;
+    index->docCount = 0;
+    index->docCapacity = 0;
+}
+
+void freeIndex(Index *index)
+{
+    for (int i = 0; i < index->dict.count; i++)
+        freePostingList(&index->postings[i]);
+    for (int d = 0; d < index->docCount; d++)
+        free(index->docNames[d]);
+    free(index->docFirstRows);
+    free(index->docBytes);
+    free(index->docCompleteBytes);
+    free(index->docNames);
+    free(index->types);
+    free(index->postings);
+    freeDict(&index->dict);
+    index->types = NULL;
+    index->postings = NULL;
+    index->capacity = 0;
+    index->docFirstRows = NULL;
+    index->docBytes = NULL;
+    index->docCompleteBytes = NULL;
+    index->docNames = NULL;
+    index->docCount = 0;
+}
+
+/* Copies word into folded in lower case and returns its length. */
+int foldWord(char *word, char *folded)
+{
+    return foldUtf8(word, strlen(word), folded);
+}
+
+int isBanned(Dict *stopWords, const char *word, int len)
+{
+    char folded[MAX_WORD_LENGTH];
+    if (len >= MAX_WORD_LENGTH)
+        return 0;
+    int foldedLen = foldUtf8(word, len, folded);
+    return dictFind(stopWords, folded, foldedLen) >= 0;
+}
+
+/* Starts a new document at the row after the last indexed one. */
+void addDocument(Index *index, char *name, unsigned long long bytes, unsigned long long completeBytes)
+{
+    if (index->docCount == index->docCapacity)
+    {
+        index->docCapacity = index->docCapacity == 0 ? 16 : index->docCapacity * 2;
+        index->docFirstRows = realloc(index->docFirstRows, index->docCapacity * sizeof(unsigned int));
+        index->docBytes = realloc(index->docBytes, index->docCapacity * sizeof(unsigned long long));
+        index->docCompleteBytes = realloc(index->docCompleteBytes, index->docCapacity * sizeof(unsigned long long));
+        index->docNames = realloc(index->docNames, index->docCapacity * sizeof(char *));
+    }
+    index->docFirstRows[index->docCount] = index->rowCount + 1;
+    index->docBytes[index->docCount] = bytes;
+    index->docCompleteBytes[index->docCount] = completeBytes;
+    index->docNames[index->docCount] = strdup(name);
+    index->docCount++;
+}
+
+/* Returns the document holding row, given the first row of each document
+ * in ascending order. */
+int findDocument(unsigned int *firstRows, int docCount, unsigned int row)
+{
+    int low = 0, high = docCount - 1;
+    while (low < high)
+    {
+        int mid = low + (high - low + 1) / 2;
+        if (firstRows[mid] <= row)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+static void growWords(Index *index)
+{
+    index->capacity = index->capacity == 0 ? DICT_INIT_CAPACITY : index->capacity * 2;
+    index->types = realloc(index->types, index->capacity * sizeof(int));
+    index->postings = realloc(index->postings, index->capacity * sizeof(PostingList));
+}
+
+/* Returns the id of word, adding it with an empty posting list if new. */
+static int internWord(Index *index, char *word, int len)
+{
+    int isNew;
+    int wordIndex = dictInsert(&index->dict, word, len, &isNew);
+    if (isNew)
+    {
+        if (wordIndex == index->capacity)
+            growWords(index);
+        initPostingList(&index->postings[wordIndex]);
+    }
+    return wordIndex;
+}
+
+void addWord(Index *index, char *word, int len, int rowIndex, int colIndex, int typeIndex)
+{
+    int wordIndex = internWord(index, word, len);
+    appendPosting(&index->postings[wordIndex], makePosting(rowIndex, colIndex));
+    index->types[wordIndex] = typeIndex;
+}
+
+/* Appends a whole run of postings for word; they must come after the
+ * ones it already has. type becomes the word's type. */
+void addPostings(Index *index, const char *word, int len, Posting *postings, int count, int type)
+{
+    int wordIndex = internWord(index, (char *)word, len);
+    PostingList *list = &index->postings[wordIndex];
+    reservePostingList(list, list->length + count);
+    memcpy(list->items + list->length, postings, count * sizeof(Posting));
+    list->length += count;
+    index->types[wordIndex] = type;
+}
+
+static void indexToken(Token *token, void *context)
+{
+    TextContext *text = context;
+    if (!isBanned(text->stopWords, token->text, token->length))
+        addWord(text->index, (char *)token->text, token->length, token->row, token->col, token->type);
+}
+
+/* Adds the words of text to index, numbering its rows after the ones
+ * already there. */
+void indexText(Index *index, Dict *stopWords, char *text, long size)
+{
+    TextContext context;
+    context.index = index;
+    context.stopWords = stopWords;
+    index->rowCount += tokenizeText(text, size, index->rowCount + 1, indexToken, &context);
+}
+
+/* Appends the occurrences of src to dst, shifting src rows down by
+ * rowOffset. src must cover rows that come after everything in dst so
+ * every posting list stays in (row, col) order. */
+void mergeIndex(Index *dst, Index *src, int rowOffset)
+{
+    Posting shift = makePosting(rowOffset, 0);
+    for (int i = 0; i < src->dict.count; i++)
+    {
+        int wordIndex = internWord(dst, src->dict.keys[i], src->dict.lengths[i]);
+        PostingList *from = &src->postings[i];
+        PostingList *to = &dst->postings[wordIndex];
+        reservePostingList(to, to->length + from->length);
+        for (int j = 0; j < from->length; j++)
+            to->items[to->length++] = from->items[j] + shift;
+        dst->types[wordIndex] = src->types[i];
+    }
+    dst->rowCount = rowOffset + src->rowCount;
+}
+
+static void *runIndexJob(void *arg)
+{
+    IndexJob *job = arg;
+    indexText(&job->index, job->stopWords, job->text, job->size);
+    return NULL;
+}
+
+/* Splits text into one chunk per thread, each ending just after a '\n',
+ * indexes the chunks concurrently and merges them in text order after the
+ * rows already in index. Proper noun detection only looks back within a
+ * row, so cutting at row boundaries gives exactly the table a single pass
+ * would. */
+void indexTextParallel(Index *index, Dict *stopWords, char *text, long size, int threads)
+{
+    if (threads > size / MIN_CHUNK_SIZE)
+        threads = size / MIN_CHUNK_SIZE;
+    if (threads <= 1)
+    {
+        indexText(index, stopWords, text, size);
+        return;
+    }
+
+    IndexJob *jobs = malloc(threads * sizeof(IndexJob));
+    long start = 0;
+    for (int k = 0; k < threads; k++)
+    {
+        long end = size;
+        if (k < threads - 1)
+        {
+            end = size / threads * (k + 1);
+            if (end < start)
+                end = start;
+            char *newline = memchr(text + end, '\n', size - end);
+            end = newline == NULL ? size : newline - text + 1;
+        }
+        initIndex(&jobs[k].index);
+        jobs[k].stopWords = stopWords;
+        jobs[k].text = text + start;
+        jobs[k].size = end - start;
+        start = end;
+    }
+
+    for (int k = 1; k < threads; k++)
+        pthread_create(&jobs[k].thread, NULL, runIndexJob, &jobs[k]);
+    runIndexJob(&jobs[0]);
+
+    for (int k = 0; k < threads; k++)
+    {
+        if (k > 0)
+            pthread_join(jobs[k].thread, NULL);
+        mergeIndex(index, &jobs[k].index, index->rowCount);
+        freeIndex(&jobs[k].index);
+    }
+    free(jobs);
+}
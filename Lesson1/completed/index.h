@@ -0,0 +1,48 @@
+#ifndef __INDEX_H__
+#define __INDEX_H__
+
+#include "dict.h"
+#include "posting.h"
+
+#define MAX_WORD_LENGTH 50
+
+/* Everything buildTable learns about a corpus: the words, the type of each
+ * word's latest occurrence and its positions, all indexed by word id.
+ * Rows are numbered across the whole corpus; document d starts at row
+ * docFirstRows[d], so a posting's (document, line) follows from its row.
+ * docBytes[d] is how much of the document was indexed and
+ * docCompleteBytes[d] where its last complete ('\n' terminated) row ends,
+ * which is where an update resumes when the file has grown. */
+struct Index_
+{
+    Dict dict;
+    int *types;
+    PostingList *postings;
+    int capacity;
+    int rowCount;
+    unsigned int *docFirstRows;
+    unsigned long long *docBytes;
+    unsigned long long *docCompleteBytes;
+    char **docNames;
+    int docCount;
+    int docCapacity;
+};
+
+typedef struct Index_ Index;
+
+void initIndex(Index *index);
+void freeIndex(Index *index);
+
+void addDocument(Index *index, char *name, unsigned long long bytes, unsigned long long completeBytes);
+int findDocument(unsigned int *firstRows, int docCount, unsigned int row);
+
+int foldWord(char *word, char *folded);
+int isBanned(Dict *stopWords, const char *word, int len);
+void addWord(Index *index, char *word, int len, int rowIndex, int colIndex, int typeIndex);
+void addPostings(Index *index, const char *word, int len, Posting *postings, int count, int type);
+
+void indexText(Index *index, Dict *stopWords, char *text, long size);
+void mergeIndex(Index *dst, Index *src, int rowOffset);
+void indexTextParallel(Index *index, Dict *stopWords, char *text, long size, int threads);
+
+#endif
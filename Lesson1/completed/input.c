@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+#include "unicode.h"
+
+static int readChunks(int fd, InputBuffer *input)
+{
+    long capacity = INPUT_CHUNK_SIZE;
+    input->data = malloc(capacity);
+    input->size = 0;
+    while (1)
+    {
+        if (input->size == capacity)
+        {
+            capacity *= 2;
+            input->data = realloc(input->data, capacity);
+        }
+        ssize_t n = read(fd, input->data + input->size, capacity - input->size);
+        if (n < 0)
+        {
+            free(input->data);
+            input->data = NULL;
+            return IO_ERROR;
+        }
+        if (n == 0)
+            return IO_SUCCESS;
+        input->size += n;
+    }
+}
+
+/* "-" reads standard input. */
+int openInput(char *fileName, InputBuffer *input)
+{
+    int fd = strcmp(fileName, "-") == 0 ? STDIN_FILENO : open(fileName, O_RDONLY);
+    if (fd < 0)
+        return IO_ERROR;
+
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = 0;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            input->data = data;
+            input->size = st.st_size;
+            input->mapped = 1;
+            if (fd != STDIN_FILENO)
+                close(fd);
+            return IO_SUCCESS;
+        }
+    }
+
+    int result = readChunks(fd, input);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return result;
+}
+
+/* Opens a text for tokenizing. UTF-8 (and so ASCII) is used as it is;
+ * UTF-16 is transcoded to UTF-8 in a heap buffer. */
+int openTextInput(char *fileName, InputBuffer *input)
+{
+    if (openInput(fileName, input) == IO_ERROR)
+        return IO_ERROR;
+    int encoding = detectEncoding((unsigned char *)input->data, input->size);
+    if (encoding == ENCODING_UTF8)
+        return IO_SUCCESS;
+
+    char *text = malloc(input->size / 2 * 3 + 1);
+    long size = utf16ToUtf8((unsigned char *)input->data, input->size, encoding, text);
+    closeInput(input);
+    input->data = text;
+    input->size = size;
+    input->mapped = 0;
+    return IO_SUCCESS;
+}
+
+void closeInput(InputBuffer *input)
+{
+    if (input->mapped)
+        munmap(input->data, input->size);
+    else
+        free(input->data);
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = 0;
+}
+
+/* Length of the prefix of data that ends with its last '\n'. */
+long completeLinesSize(const char *data, long size)
+{
+    while (size > 0 && data[size - 1] != '\n')
+        size--;
+    return size;
+}
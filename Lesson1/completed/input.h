@@ -0,0 +1,25 @@
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#define IO_ERROR 0
+#define IO_SUCCESS 1
+
+#define INPUT_CHUNK_SIZE 65536
+
+/* The whole content of an input file. Regular files are mapped read-only;
+ * pipes and other unmappable inputs are read in chunks into a heap buffer. */
+struct InputBuffer_
+{
+    char *data;
+    long size;
+    int mapped;
+};
+
+typedef struct InputBuffer_ InputBuffer;
+
+int openInput(char *fileName, InputBuffer *input);
+int openTextInput(char *fileName, InputBuffer *input);
+void closeInput(InputBuffer *input);
+long completeLinesSize(const char *data, long size);
+
+#endif
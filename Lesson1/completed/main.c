@@ -3,347 +3,197 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-
-#define MAX_ROWS 1000
-#define MAX_COLS 1000
-#define MAX_WORDS 1000
-#define MAX_NUMS 1000
-#define MAX_WORD_LENGTH 50
-
-char *VAN_BAN_PATH = "vanban.txt";
-char *STOPW_PATH = "stopw.txt";
-
-char *bannedWords[MAX_WORDS];
-char *words[MAX_WORDS];
-int rowIndices[MAX_WORDS][MAX_ROWS];
-int colIndices[MAX_WORDS][MAX_COLS];
-int types[MAX_NUMS];
-
-int compareLowerString(char *s1, char *s2)
-{
-    char *us1 = (char *)s1,
-         *us2 = (char *)s2;
-
-    while (tolower(*us1) == tolower(*us2++))
-        if (*us1++ == '\0')
-            return (0);
-    return (tolower(*us1) - tolower(*--us2));
-}
-
-int isAlphabetWord(char *word)
-{
-    for (int i = 0; i < strlen(word); i++)
-    {
-        if (!isalpha(word[i]))
-        {
-            return 0;
-        }
-    }
-    return 1;
+#include <unistd.h>
+
+#include "table.h"
+#include "store.h"
+#include "update.h"
+#include "spimi.h"
+#include "server.h"
+#include "segment.h"
+#include "query.h"
+
+char *indexPath = NULL;
+char *queryPath = NULL;
+char *updatePath = NULL;
+char *socketPath = NULL;
+char *appendPath = NULL;
+char *compactPath = NULL;
+int topCount = 0;
+int approximate = 0;
+long memoryBudget = 0;
+
+/* Answers each query with printQuery. The stop words are only needed,
+ * and read, for phrase and proximity queries. */
+int queryIndex(char *fileName, char **queries, int queryCount)
+{
+    SegmentSet set;
+    if (openSegmentSet(fileName, &set) == IO_ERROR)
+    {
+        printf("Cannot open index %s\n", fileName);
+        return -1;
+    }
+    int stopWordsRead = 0;
+    for (int q = 0; q < queryCount && !stopWordsRead; q++)
+    {
+        if (isPhraseQuery(queries[q]))
+        {
+            readFileStopWord(STOPW_PATH);
+            stopWordsRead = 1;
+        }
+    }
+    for (int q = 0; q < queryCount; q++)
+        printQuery(&output, &set, &stopWords, queries[q]);
+    flushOutput(&output);
+    if (stopWordsRead)
+        freeDict(&stopWords);
+    closeSegmentSet(&set);
+    return 0;
 }
 
-int isInteger(char *input)
+/* Merges the segments of dir as far as the policy goes and reports what
+ * writing them has cost so far. */
+int compactIndex(char *dir)
 {
-    for (int i = 0; i < strlen(input); i++)
+    Manifest manifest;
+    if (compactSegments(dir) == IO_ERROR || readManifest(dir, &manifest) == IO_ERROR)
     {
-        if (!isdigit(input[i]))
-        {
-            return 0;
-        }
+        printf("Cannot merge segments of %s\n", dir);
+        return -1;
     }
-    return 1;
+    printf("Segments: %d Ingested: %llu bytes Written: %llu bytes Write amplification: %.2f\n",
+           manifest.count, manifest.ingested, manifest.written,
+           manifest.ingested > 0 ? (double)manifest.written / manifest.ingested : 0.0);
+    freeManifest(&manifest);
+    return 0;
 }
 
-int isDouble(char *input)
-{
-    int num_digits = 0;
-    for (int i = 0; i < strlen(input); i++)
-    {
-        if (i == 0)
-        {
-            if (input[i] == '-' || input[i] == '+')
-                continue;
-        }
-        if (input[i] == '.')
-        {
-            if (num_digits == 0)
-                return 0;
-        }
+int main(int argc, char *argv[])
+{
+    threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    initOutput(&output, stdout);
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:q:u:s:f:k:aF:m:S:A:M:")) != -1)
+    {
+        if (opt == 'j')
+            threadCount = atoi(optarg);
+        else if (opt == 's')
+            STOPW_PATH = optarg;
+        else if (opt == 'f')
+            readFileList(optarg);
+        else if (opt == 'o')
+            indexPath = optarg;
+        else if (opt == 'q')
+            queryPath = optarg;
+        else if (opt == 'u')
+            updatePath = optarg;
+        else if (opt == 'S')
+            socketPath = optarg;
+        else if (opt == 'A')
+            appendPath = optarg;
+        else if (opt == 'M')
+            compactPath = optarg;
+        else if (opt == 'k')
+            topCount = atoi(optarg);
+        else if (opt == 'a')
+            approximate = 1;
+        else if (opt == 'm' && atol(optarg) > 0)
+            memoryBudget = atol(optarg) << 20;
+        else if (opt == 'F' && parseFormat(optarg) >= 0)
+            outputFormat = parseFormat(optarg);
         else
         {
-            if (isdigit(input[i]))
-            {
-                num_digits++;
-            }
-            else
-                return 0;
-        }
-    } /* end for loop */
-    if (num_digits == 0)
-        return 0;
-    else
-        return 1;
-}
-
-void cleanLine(char *str)
-{
-    int len = strlen(str);
-    for (int i = 0; i < len; i++)
-    {
-        if (!isalnum(str[i]) && str[i] != '.' && str[i] != ',' && str[i] != '-' && str[i] != ' ')
-        {
-            for (int j = i; j < len; j++)
-            {
-                str[j] = str[j + 1];
-            }
-            len--;
-            i--;
+            printf("Usage: %s [-j threads] [-s stopwords] [-f filelist] [-o index] [-F text|jsonl|binary] [text...]\n"
+                   "       %s [-j threads] [-s stopwords] [-f filelist] -o index -m megabytes [text...]\n"
+                   "       %s [-j threads] [-s stopwords] [-f filelist] -k count [-a] [text...]\n"
+                   "       %s [-j threads] [-s stopwords] [-f filelist] -u index [text...]\n"
+                   "       %s [-j threads] [-s stopwords] [-f filelist] [-m megabytes] -A directory [text...]\n"
+                   "       %s -M directory\n"
+                   "       %s [-s stopwords] -q index|directory query...\n"
+                   "       %s [-j threads] [-s stopwords] -q index|directory -S socket|-\n",
+                   argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return -1;
         }
     }
-    str[len] = ' ';
-}
-
-void cleanWord(char *str)
-{
-    if (!isInteger(str) && !isDouble(str))
+    if (queryPath != NULL && socketPath != NULL)
     {
-        for (int i = 0; i < strlen(str); i++)
+        readFileStopWord(STOPW_PATH);
+        if (serveIndex(queryPath, socketPath, &stopWords, threadCount) == IO_ERROR)
         {
-            if (!isalnum(str[i]) && str[i] != '-')
-            {
-                if (str[i] == '.')
-                {
-                    if (isupper(str[i + 1]))
-                        continue;
-                    else if (str[i + 1] == '\0')
-                        str[i] = '\0';
-                }
-                str[i] = '\0';
-                break;
-            }
-        }
-    }
-}
-
-int isLastWord(char *word)
-{
-    return word[strlen(word) - 1] == '.' ? 1 : 0;
-}
-
-int isProperNoun(char *word, char *prevWord)
-{
-    if (strlen(prevWord) != 0 && isupper(word[0]) && !isLastWord(prevWord))
-    {
-        return 1;
-    }
-    return 0;
-}
-
-int isBanned(char word[])
-{
-    for (int i = 0; i < MAX_WORDS && bannedWords[i] != NULL; i++)
-    {
-        if (compareLowerString(word, bannedWords[i]) == 0)
-        {
-            return 1;
+            printf("Cannot serve index %s on %s\n", queryPath, socketPath);
+            return -1;
         }
+        return 0;
     }
-    return 0;
-}
-
-void appendWordPosition(int wordIndex, int rowIndex, int colIndex, int typeIndex)
-{
-    for (int i = 0; i < MAX_ROWS; i++)
+    if (queryPath != NULL)
+        return queryIndex(queryPath, argv + optind, argc - optind);
+    if (compactPath != NULL)
+        return compactIndex(compactPath);
+    for (int i = optind; i < argc; i++)
     {
-        if (rowIndices[wordIndex][i] == 0)
-        {
-            rowIndices[wordIndex][i] = rowIndex;
-            colIndices[wordIndex][i] = colIndex;
-            types[wordIndex] = typeIndex;
-            return;
-        }
+        documentPaths = realloc(documentPaths, (documentCount + 1) * sizeof(char *));
+        documentPaths[documentCount++] = argv[i];
     }
-}
-
-void appendWords(char word[], int rowIndex, int colIndex, int typeIndex)
-{
-    for (int i = 0; i < MAX_WORDS; i++)
+    if (updatePath != NULL)
     {
-        if (words[i] == NULL)
+        readFileStopWord(STOPW_PATH);
+        if (updateIndexFile(updatePath, documentPaths, documentCount, &stopWords, threadCount) == IO_ERROR)
         {
-            words[i] = malloc(strlen(word) + 1);
-            strcpy(words[i], word);
-            appendWordPosition(i, rowIndex, colIndex, typeIndex);
-            return;
-        }
-        else if (strcmp(words[i], word) == 0)
-        {
-            appendWordPosition(i, rowIndex, colIndex, typeIndex);
-            return;
+            printf("Cannot update index %s\n", updatePath);
+            return -1;
         }
+        return 0;
     }
-}
-
-int numberOfOccurences(int wordIndex)
-{
-    int count = 0;
-    for (int i = 0; i < MAX_ROWS; i++)
+    if (appendPath != NULL)
     {
-        if (rowIndices[wordIndex][i] != 0)
+        readFileStopWord(STOPW_PATH);
+        if (appendSegment(appendPath, documentPaths, documentCount, &stopWords, threadCount, memoryBudget) == IO_ERROR)
         {
-            count += 1;
+            printf("Cannot append to index %s\n", appendPath);
+            return -1;
         }
-        else
-        {
-            break;
-        }
-    }
-    return count;
-}
-
-void readFileStopWord(char *fileName)
-{
-    FILE *fp = fopen(fileName, "r");
-    if (fp == NULL)
-    {
-        printf("Cannot open file %s\n", fileName);
-        return;
+        return 0;
     }
-
-    int wordIndex = 0;
-    char word[MAX_WORD_LENGTH];
-    while (fscanf(fp, "%s", word) != EOF)
+    if (documentCount == 0)
     {
-        bannedWords[wordIndex] = malloc(strlen(word) * sizeof(char));
-        strcpy(bannedWords[wordIndex], word);
-        wordIndex += 1;
+        documentPaths = malloc(sizeof(char *));
+        documentPaths[documentCount++] = VAN_BAN_PATH;
     }
-    fclose(fp);
-}
-
-void buildTable()
-{
     readFileStopWord(STOPW_PATH);
-    FILE *fp = fopen(VAN_BAN_PATH, "r");
-    if (fp == NULL)
+    if (topCount > 0 && approximate)
     {
-        printf("Cannot open file %s", VAN_BAN_PATH);
-        return;
+        SpaceSaving sketch;
+        initSpaceSaving(&sketch, topCount * SKETCH_FACTOR);
+        sketchTable(&sketch);
+        printSketchTop(&sketch, topCount);
+        freeSpaceSaving(&sketch);
+        return 0;
     }
-    int rowIndex = 1;
-    char line[MAX_COLS];
-    while (fgets(line, MAX_COLS, fp) != NULL)
+    if (indexPath != NULL && memoryBudget > 0)
     {
-        cleanLine(line);
-        char prevWord[MAX_WORD_LENGTH];
-        prevWord[0] = '\0';
-        char word[MAX_WORD_LENGTH];
-        int typeIndex = 0;
-        int colIndex = 1;
-        int k = 0;
-        for (int i = 0; i < strlen(line); i++)
+        if (buildIndexFile(indexPath, documentPaths, documentCount, &stopWords, threadCount, memoryBudget) == IO_ERROR)
         {
-            if (line[i] == ' ' || line[i] == '\0' || line[i] == '\n' || line[i] == EOF)
-            {
-                word[k] = '\0';
-                char cleanedWord[MAX_WORD_LENGTH];
-                strcpy(cleanedWord, word);
-                cleanWord(cleanedWord);
-                if (strlen(cleanedWord) != 0 && !isBanned(cleanedWord))
-                {
-                    if (isProperNoun(cleanedWord, prevWord))
-                        typeIndex = 1;
-                    else if (isInteger(cleanedWord))
-                        typeIndex = 2;
-                    else if (isDouble(cleanedWord))
-                        typeIndex = 3;
-                    else if (isAlphabetWord(cleanedWord))
-                        typeIndex = 0;
-                    appendWords(cleanedWord, rowIndex, colIndex, typeIndex);
-                }
-                colIndex += 1;
-                k = 0;
-                strcpy(prevWord, word);
-            }
-            else
-            {
-                word[k] = line[i];
-                k += 1;
-            }
+            printf("Cannot write index %s\n", indexPath);
+            return -1;
         }
-        rowIndex++;
-    }
-    fclose(fp);
-}
-
-void swap(int i, int j)
-{
-    char *temp = words[i];
-    words[i] = words[j];
-    words[j] = temp;
-
-    int tmp = types[i];
-    types[i] = types[j];
-    types[j] = tmp;
-
-    for (int k = 0; k < MAX_ROWS; k++)
-    {
-        int temp = rowIndices[i][k];
-        rowIndices[i][k] = rowIndices[j][k];
-        rowIndices[j][k] = temp;
-    }
-
-    for (int k = 0; k < MAX_COLS; k++)
-    {
-        int temp = colIndices[i][k];
-        colIndices[i][k] = colIndices[j][k];
-        colIndices[j][k] = temp;
+        return 0;
     }
-}
-
-void sortTable()
-{
-    for (int i = 0; i < MAX_WORDS && words[i] != NULL; i++)
+    buildTable();
+    if (topCount > 0)
     {
-        for (int j = i + 1; j < MAX_WORDS && words[j] != NULL; j++)
-        {
-            if (strcmp(words[j], words[i]) < 0)
-            {
-                swap(i, j);
-            }
-        }
+        printTopWords(topCount);
+        return 0;
     }
-}
-
-void printTable()
-{
-    printf("0: normal\n1: proper noun\n2: integer\n3: real number\n\n");
-    for (int i = 0; i < MAX_WORDS; i++)
+    sortTable();
+    if (indexPath != NULL)
     {
-        if (words[i] == NULL)
-        {
-            break;
-        }
-        else
+        if (writeIndexFile(indexPath, &table, order) == IO_ERROR)
         {
-            printf("%-15s Appear: %d Type: %d Positions:", words[i], numberOfOccurences(i), types[i]);
-            for (int j = 0; j < MAX_ROWS; j++)
-            {
-                if (rowIndices[i][j] == 0)
-                {
-                    break;
-                }
-                printf(" (%d, %d)", rowIndices[i][j], colIndices[i][j]);
-            }
-            printf("\n");
+            printf("Cannot write index %s\n", indexPath);
+            return -1;
         }
+        return 0;
     }
-}
-
-int main()
-{
-    buildTable();
-    sortTable();
     printTable();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "output.h"
+
+static const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void initOutput(OutputWriter *out, FILE *file)
+{
+    out->file = file;
+    out->used = 0;
+}
+
+void flushOutput(OutputWriter *out)
+{
+    if (out->used > 0)
+        fwrite(out->buffer, 1, out->used, out->file);
+    out->used = 0;
+    fflush(out->file);
+}
+
+void writeBytes(OutputWriter *out, const void *data, long len)
+{
+    const char *bytes = data;
+    while (len > 0)
+    {
+        if (out->used == OUTPUT_BUFFER_SIZE)
+            flushOutput(out);
+        long room = OUTPUT_BUFFER_SIZE - out->used;
+        long n = len < room ? len : room;
+        memcpy(out->buffer + out->used, bytes, n);
+        out->used += n;
+        bytes += n;
+        len -= n;
+    }
+}
+
+void writeString(OutputWriter *out, const char *text)
+{
+    writeBytes(out, text, strlen(text));
+}
+
+/* Like printf's %-*s: text, then spaces up to width bytes. */
+void writePadded(OutputWriter *out, const char *text, int width)
+{
+    int len = strlen(text);
+    writeBytes(out, text, len);
+    for (; len < width; len++)
+        writeChar(out, ' ');
+}
+
+/* Decimal digits, two at a time from the end, into a small local buffer. */
+void writeUnsigned(OutputWriter *out, unsigned long long value)
+{
+    char digits[20];
+    int pos = sizeof(digits);
+    while (value >= 100)
+    {
+        int pair = (value % 100) * 2;
+        value /= 100;
+        digits[--pos] = digitPairs[pair + 1];
+        digits[--pos] = digitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        digits[--pos] = digitPairs[value * 2 + 1];
+        digits[--pos] = digitPairs[value * 2];
+    }
+    else
+        digits[--pos] = '0' + value;
+    writeBytes(out, digits + pos, sizeof(digits) - pos);
+}
+
+void writeSigned(OutputWriter *out, long long value)
+{
+    if (value < 0)
+    {
+        writeChar(out, '-');
+        writeUnsigned(out, -(unsigned long long)value);
+    }
+    else
+        writeUnsigned(out, value);
+}
+
+/* LEB128, as in the index file's postings. */
+void writeVarint(OutputWriter *out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        writeChar(out, (char)(value | 0x80));
+        value >>= 7;
+    }
+    writeChar(out, (char)value);
+}
+
+void writeJsonString(OutputWriter *out, const char *text)
+{
+    static const char hex[] = "0123456789abcdef";
+    writeChar(out, '"');
+    for (const unsigned char *p = (const unsigned char *)text; *p != '\0'; p++)
+    {
+        if (*p == '"' || *p == '\\')
+        {
+            writeChar(out, '\\');
+            writeChar(out, *p);
+        }
+        else if (*p < 0x20)
+        {
+            writeString(out, "\\u00");
+            writeChar(out, hex[*p >> 4]);
+            writeChar(out, hex[*p & 15]);
+        }
+        else
+            writeChar(out, *p);
+    }
+    writeChar(out, '"');
+}
+
+/* FORMAT_* for a -F argument, or -1. */
+int parseFormat(const char *name)
+{
+    if (strcmp(name, "text") == 0)
+        return FORMAT_TEXT;
+    if (strcmp(name, "jsonl") == 0)
+        return FORMAT_JSONL;
+    if (strcmp(name, "binary") == 0)
+        return FORMAT_BINARY;
+    return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+#define FORMAT_TEXT 0
+#define FORMAT_JSONL 1
+#define FORMAT_BINARY 2
+
+/* Collects output in a large buffer and hands it to file in big fwrite
+ * calls, formatting numbers itself instead of going through printf.
+ * Anything printed to file directly must come after a flushOutput. */
+struct OutputWriter_
+{
+    FILE *file;
+    int used;
+    char buffer[OUTPUT_BUFFER_SIZE];
+};
+
+typedef struct OutputWriter_ OutputWriter;
+
+void initOutput(OutputWriter *out, FILE *file);
+void flushOutput(OutputWriter *out);
+
+void writeBytes(OutputWriter *out, const void *data, long len);
+void writeString(OutputWriter *out, const char *text);
+void writePadded(OutputWriter *out, const char *text, int width);
+void writeUnsigned(OutputWriter *out, unsigned long long value);
+void writeSigned(OutputWriter *out, long long value);
+void writeVarint(OutputWriter *out, unsigned long long value);
+void writeJsonString(OutputWriter *out, const char *text);
+
+static inline void writeChar(OutputWriter *out, char c)
+{
+    if (out->used == OUTPUT_BUFFER_SIZE)
+        flushOutput(out);
+    out->buffer[out->used++] = c;
+}
+
+int parseFormat(const char *name);
+
+#endif
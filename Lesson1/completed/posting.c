@@ -0,0 +1,150 @@
+#include <stdlib.h>
+
+#include "posting.h"
+
+#define POSTING_INIT_CAPACITY 4
+
+void initPostingList(PostingList *list)
+{
+    list->items = NULL;
+    list->length = 0;
+    list->capacity = 0;
+}
+
+void freePostingList(PostingList *list)
+{
+    free(list->items);
+    initPostingList(list);
+}
+
+void reservePostingList(PostingList *list, int capacity)
+{
+    if (capacity > list->capacity)
+    {
+        list->capacity = capacity;
+        list->items = realloc(list->items, list->capacity * sizeof(Posting));
+    }
+}
+
+void appendPosting(PostingList *list, Posting posting)
+{
+    if (list->length == list->capacity)
+    {
+        list->capacity = list->capacity == 0 ? POSTING_INIT_CAPACITY : list->capacity * 2;
+        list->items = realloc(list->items, list->capacity * sizeof(Posting));
+    }
+    list->items[list->length++] = posting;
+}
+
+int varintSize(unsigned int value)
+{
+    int size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+unsigned char *putVarint(unsigned char *out, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+unsigned char *putLongVarint(unsigned char *out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+/* Reads a varint from fp; what there is of one cut short by the end of
+ * the file. */
+unsigned int readFileVarint(FILE *fp)
+{
+    unsigned int value = 0;
+    int shift = 0, c;
+    while ((c = getc(fp)) != EOF)
+    {
+        value |= (unsigned int)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            break;
+        shift += 7;
+    }
+    return value;
+}
+
+const unsigned char *getBoundedVarint(const unsigned char *in, const unsigned char *end, unsigned long long *value)
+{
+    unsigned long long result = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *in++;
+        result |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+long encodedPostingsSize(Posting *postings, int count)
+{
+    long size = 0;
+    unsigned int prevRow = 0, prevCol = 0;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int row = postingRow(postings[i]);
+        unsigned int col = postingCol(postings[i]);
+        size += varintSize(row - prevRow);
+        size += varintSize(row == prevRow ? col - prevCol : col);
+        prevRow = row;
+        prevCol = col;
+    }
+    return size;
+}
+
+long encodePostings(Posting *postings, int count, unsigned char *out)
+{
+    unsigned char *start = out;
+    unsigned int prevRow = 0, prevCol = 0;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int row = postingRow(postings[i]);
+        unsigned int col = postingCol(postings[i]);
+        out = putVarint(out, row - prevRow);
+        out = putVarint(out, row == prevRow ? col - prevCol : col);
+        prevRow = row;
+        prevCol = col;
+    }
+    return out - start;
+}
+
+/* Decodes count postings and returns the first byte after them. */
+const unsigned char *decodePostings(const unsigned char *in, Posting *out, int count)
+{
+    unsigned int row = 0, col = 0;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int rowGap, value;
+        in = getVarint(in, &rowGap);
+        in = getVarint(in, &value);
+        col = rowGap == 0 ? col + value : value;
+        row += rowGap;
+        out[i] = makePosting(row, col);
+    }
+    return in;
+}
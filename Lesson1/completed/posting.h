@@ -0,0 +1,73 @@
+#ifndef __POSTING_H__
+#define __POSTING_H__
+
+#include <stdio.h>
+
+/* One occurrence of a word: row in the high 32 bits, column in the low 32
+ * bits, so postings of a word compare in (row, col) order as plain integers. */
+typedef unsigned long long Posting;
+
+#define makePosting(row, col) (((Posting)(unsigned int)(row) << 32) | (unsigned int)(col))
+#define postingRow(p) ((int)((p) >> 32))
+#define postingCol(p) ((int)((p) & 0xffffffffu))
+
+struct PostingList_
+{
+    Posting *items;
+    int length;
+    int capacity;
+};
+
+typedef struct PostingList_ PostingList;
+
+void initPostingList(PostingList *list);
+void freePostingList(PostingList *list);
+void reservePostingList(PostingList *list, int capacity);
+void appendPosting(PostingList *list, Posting posting);
+
+/* LEB128 varints: seven bits a byte, low bits first, the top bit set on
+ * every byte but the last, as the index files store them. The Long forms
+ * are for the 64-bit ranks and offsets of the key automaton. */
+int varintSize(unsigned int value);
+unsigned char *putVarint(unsigned char *out, unsigned int value);
+unsigned char *putLongVarint(unsigned char *out, unsigned long long value);
+unsigned int readFileVarint(FILE *fp);
+
+/* getLongVarint for bytes that are not known to hold a whole varint:
+ * returns NULL unless one of at most ten bytes ends before end. */
+const unsigned char *getBoundedVarint(const unsigned char *in, const unsigned char *end, unsigned long long *value);
+
+static inline const unsigned char *getVarint(const unsigned char *in, unsigned int *value)
+{
+    unsigned int result = *in & 0x7f;
+    int shift = 7;
+    while (*in++ & 0x80)
+    {
+        result |= (unsigned int)(*in & 0x7f) << shift;
+        shift += 7;
+    }
+    *value = result;
+    return in;
+}
+
+static inline const unsigned char *getLongVarint(const unsigned char *in, unsigned long long *value)
+{
+    unsigned long long result = *in & 0x7f;
+    int shift = 7;
+    while (*in++ & 0x80)
+    {
+        result |= (unsigned long long)(*in & 0x7f) << shift;
+        shift += 7;
+    }
+    *value = result;
+    return in;
+}
+
+/* Compressed form of a posting list: for each posting the row gap to the
+ * previous posting, then the column, or the column gap when the row gap
+ * is zero, each as a varint. */
+long encodedPostingsSize(Posting *postings, int count);
+long encodePostings(Posting *postings, int count, unsigned char *out);
+const unsigned char *decodePostings(const unsigned char *in, Posting *out, int count);
+
+#endif
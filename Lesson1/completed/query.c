@@ -0,0 +1,679 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+#include "fuzzy.h"
+#include "index.h"
+
+void freeMatchList(MatchList *matches)
+{
+    free(matches->items);
+    matches->items = NULL;
+    matches->length = 0;
+}
+
+/* Returns the first index at or after from whose posting is not below
+ * target, or length if there is none. Probes from + 1, + 2, + 4, ...
+ * and binary searches the last step, so skipping n postings costs
+ * O(log n) instead of n comparisons. */
+int gallop(const Posting *items, int length, int from, Posting target)
+{
+    if (from >= length || items[from] >= target)
+        return from;
+    int low = from;
+    int step = 1;
+    int high = from + 1;
+    while (high < length && items[high] < target)
+    {
+        low = high;
+        step *= 2;
+        high = from + step;
+    }
+    if (high > length)
+        high = length;
+    while (high - low > 1)
+    {
+        int mid = low + (high - low) / 2;
+        if (items[mid] < target)
+            low = mid;
+        else
+            high = mid;
+    }
+    return high;
+}
+
+/* The earliest phrase start that could put a word at offset on found or
+ * after it. */
+static Posting anchorFor(Posting found, int offset)
+{
+    if (postingCol(found) > offset)
+        return found - offset;
+    return makePosting(postingRow(found), 1);
+}
+
+/* Finds the rows where, for every i, lists[i] has a posting offsets[i]
+ * columns after a common start, and stores those starts in out. The
+ * lists take turns proposing a start: each one gallops to where the
+ * current start needs it and, if it has nothing there, moves the start
+ * past its next posting. A match is found once count lists in a row
+ * agree, so a frequent word is only probed where the rarer ones are. */
+void matchPhrase(Posting **lists, int *lengths, int *offsets, int count, int width, MatchList *out)
+{
+    int cursors[MAX_QUERY_WORDS];
+    int shortest = 0;
+    for (int i = 0; i < count; i++)
+    {
+        cursors[i] = 0;
+        if (lengths[i] < lengths[shortest])
+            shortest = i;
+    }
+    out->items = malloc((lengths[shortest] + 1) * sizeof(Posting));
+    out->length = 0;
+    out->width = width;
+
+    Posting start = makePosting(0, 1);
+    int agreed = 0;
+    int i = shortest;
+    while (1)
+    {
+        Posting target = start + offsets[i];
+        cursors[i] = gallop(lists[i], lengths[i], cursors[i], target);
+        if (cursors[i] == lengths[i])
+            break;
+        Posting found = lists[i][cursors[i]];
+        if (found != target)
+        {
+            start = anchorFor(found, offsets[i]);
+            agreed = 0;
+        }
+        if (start + offsets[i] == found && ++agreed == count)
+        {
+            out->items[out->length++] = start;
+            start++;
+            agreed = 0;
+        }
+        i = (i + 1) % count;
+    }
+}
+
+/* Keeps the matches of left that have a match of right in the same row,
+ * not overlapping it and at most distance fields away on either side. */
+void matchNear(MatchList *left, MatchList *right, int distance, MatchList *out)
+{
+    out->items = malloc((left->length + 1) * sizeof(Posting));
+    out->length = 0;
+    out->width = left->width;
+
+    int i = 0, j = 0;
+    while (i < left->length && j < right->length)
+    {
+        Posting start = left->items[i];
+        int row = postingRow(start);
+        long col = postingCol(start);
+        long low = col - distance - right->width + 1;
+        j = gallop(right->items, right->length, j, makePosting(row, low < 1 ? 1 : low));
+        if (j == right->length)
+            break;
+
+        Posting last = makePosting(row, col + left->width - 1 + distance);
+        int near = 0;
+        for (int k = j; k < right->length && right->items[k] <= last; k++)
+        {
+            long other = postingCol(right->items[k]);
+            if (other + right->width <= col || other >= col + left->width)
+            {
+                near = 1;
+                break;
+            }
+        }
+        if (near)
+        {
+            out->items[out->length++] = start;
+            i++;
+        }
+        else if (right->items[j] > last)
+        {
+            /* skip the left matches too far before the next right one */
+            Posting next = right->items[j];
+            long first = (long)postingCol(next) - distance - left->width + 1;
+            i = gallop(left->items, left->length, i + 1, makePosting(postingRow(next), first < 1 ? 1 : first));
+        }
+        else
+            i++;
+    }
+}
+
+/* Matches one phrase. Stop words are not indexed, so they only hold
+ * their place; any other word missing from the index means no match. */
+static void matchWords(StoredIndex *stored, Dict *stopWords, char **words, int count, MatchList *out)
+{
+    Posting *lists[MAX_QUERY_WORDS];
+    int lengths[MAX_QUERY_WORDS];
+    int offsets[MAX_QUERY_WORDS];
+    int kept = 0;
+    int missing = 0;
+    for (int w = 0; w < count && !missing; w++)
+    {
+        int len = strlen(words[w]);
+        int term = findTerm(stored, words[w], len);
+        if (term < 0)
+        {
+            missing = !isBanned(stopWords, words[w], len);
+            continue;
+        }
+        lengths[kept] = stored->terms[term].postingCount;
+        lists[kept] = malloc((lengths[kept] + 1) * sizeof(Posting));
+        readTermPostings(stored, term, lists[kept]);
+        offsets[kept] = w;
+        kept++;
+    }
+
+    if (kept == 0 || missing)
+    {
+        out->items = NULL;
+        out->length = 0;
+        out->width = count;
+    }
+    else
+        matchPhrase(lists, lengths, offsets, kept, count, out);
+    for (int k = 0; k < kept; k++)
+        free(lists[k]);
+}
+
+/* Answers query, a sequence of phrases joined by NEAR/k, left to right:
+ * "a b NEAR/3 c" matches the phrase "a b" wherever c is at most 3 fields
+ * from it. Double quotes around phrases are allowed and ignored.
+ * Returns IO_ERROR if the query is malformed. */
+int runQuery(StoredIndex *stored, Dict *stopWords, const char *query, MatchList *out)
+{
+    char *text = strdup(query);
+    char *words[MAX_QUERY_WORDS];
+    int count = 0;
+    int distance = 0;
+    int first = 1;
+    int status = IO_SUCCESS;
+    char *save;
+    out->items = NULL;
+    out->length = 0;
+    out->width = 0;
+
+    for (char *word = strtok_r(text, " \t", &save);; word = strtok_r(NULL, " \t", &save))
+    {
+        int isNear = word != NULL && strncmp(word, "NEAR/", 5) == 0;
+        if (word == NULL || isNear)
+        {
+            if (count == 0)
+            {
+                status = IO_ERROR;
+                break;
+            }
+            MatchList operand;
+            matchWords(stored, stopWords, words, count, &operand);
+            if (first)
+                *out = operand;
+            else
+            {
+                MatchList joined;
+                matchNear(out, &operand, distance, &joined);
+                freeMatchList(out);
+                freeMatchList(&operand);
+                *out = joined;
+            }
+            first = 0;
+            count = 0;
+            if (word == NULL)
+                break;
+            char *end;
+            distance = strtol(word + 5, &end, 10);
+            if (*end != '\0' || distance < 1)
+            {
+                status = IO_ERROR;
+                break;
+            }
+            continue;
+        }
+
+        while (*word == '"')
+            word++;
+        int len = strlen(word);
+        while (len > 0 && word[len - 1] == '"')
+            word[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (count == MAX_QUERY_WORDS)
+        {
+            status = IO_ERROR;
+            break;
+        }
+        words[count++] = word;
+    }
+
+    free(text);
+    if (status == IO_ERROR)
+        freeMatchList(out);
+    return status;
+}
+
+static RowCursor *newCursor(int kind, long cost)
+{
+    RowCursor *cursor = calloc(1, sizeof(RowCursor));
+    cursor->kind = kind;
+    cursor->cost = cost;
+    return cursor;
+}
+
+/* Streams the rows of a decoded position list, merging or galloping as
+ * makeAndCursor decides. Queries read their words as row sets instead;
+ * this is kept as the baseline benchIntersection measures them against.
+ * Takes ownership of postings, which may be NULL when length is 0. */
+RowCursor *makeTermCursor(Posting *postings, int length)
+{
+    RowCursor *cursor = newCursor(CURSOR_TERM, length);
+    cursor->postings = postings;
+    cursor->length = length;
+    cursor->gallops = 1;
+    return cursor;
+}
+
+/* Takes ownership of rows. */
+RowCursor *makeSetCursor(RowSet *rows)
+{
+    RowCursor *cursor = newCursor(CURSOR_SET, rows->rowCount);
+    cursor->rows = rows;
+    return cursor;
+}
+
+static RowCursor *makeParentCursor(int kind, RowCursor **children, int count, long cost)
+{
+    RowCursor *cursor = newCursor(kind, cost);
+    cursor->children = malloc(count * sizeof(RowCursor *));
+    memcpy(cursor->children, children, count * sizeof(RowCursor *));
+    cursor->childCount = count;
+    return cursor;
+}
+
+/* Replaces the row set operands of an AND by their intersection,
+ * smallest first, and returns the new number of operands. */
+static int intersectSetCursors(RowCursor **children, int count)
+{
+    RowCursor *smallest = NULL;
+    int sets = 0;
+    for (int i = 0; i < count; i++)
+        if (children[i]->kind == CURSOR_SET)
+        {
+            sets++;
+            if (smallest == NULL || children[i]->cost < smallest->cost)
+                smallest = children[i];
+        }
+    if (sets < 2)
+        return count;
+    RowSet *result = smallest->rows;
+    smallest->rows = NULL;
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (children[i]->kind != CURSOR_SET)
+        {
+            children[kept++] = children[i];
+            continue;
+        }
+        if (children[i] != smallest)
+        {
+            RowSet *next = malloc(sizeof(RowSet));
+            initRowSet(next);
+            intersectRowSets(result, children[i]->rows, next);
+            freeRowSet(result);
+            free(result);
+            result = next;
+        }
+        freeRowCursor(children[i]);
+    }
+    children[kept++] = makeSetCursor(result);
+    return kept;
+}
+
+/* Sorts the operands by cost so the cheapest one proposes the rows and
+ * the others are only asked about those. Term lists at most gallopRatio
+ * times longer than the cheapest are merged one posting at a time, the
+ * longer ones are galloped through. Row sets are intersected first, so
+ * an AND of words alone becomes the set of their common rows. */
+RowCursor *makeAndCursor(RowCursor **children, int count, int gallopRatio)
+{
+    RowCursor **operands = malloc(count * sizeof(RowCursor *));
+    memcpy(operands, children, count * sizeof(RowCursor *));
+    count = intersectSetCursors(operands, count);
+    if (count == 1)
+    {
+        RowCursor *only = operands[0];
+        free(operands);
+        return only;
+    }
+    RowCursor *cursor = makeParentCursor(CURSOR_AND, operands, count, 0);
+    free(operands);
+    RowCursor **sorted = cursor->children;
+    for (int i = 1; i < count; i++)
+    {
+        RowCursor *child = sorted[i];
+        int j = i;
+        for (; j > 0 && sorted[j - 1]->cost > child->cost; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = child;
+    }
+    cursor->cost = sorted[0]->cost;
+    for (int i = 1; i < count; i++)
+        if (sorted[i]->kind == CURSOR_TERM)
+            sorted[i]->gallops = sorted[i]->cost > (long)gallopRatio * sorted[0]->cost;
+    return cursor;
+}
+
+RowCursor *makeOrCursor(RowCursor **children, int count)
+{
+    long cost = 0;
+    for (int i = 0; i < count; i++)
+        cost += children[i]->cost;
+    return makeParentCursor(CURSOR_OR, children, count, cost);
+}
+
+RowCursor *makeNotCursor(RowCursor *child, int rowCount)
+{
+    RowCursor *cursor = makeParentCursor(CURSOR_NOT, &child, 1, rowCount);
+    cursor->rowCount = rowCount;
+    return cursor;
+}
+
+void freeRowCursor(RowCursor *cursor)
+{
+    for (int i = 0; i < cursor->childCount; i++)
+        freeRowCursor(cursor->children[i]);
+    free(cursor->children);
+    free(cursor->postings);
+    if (cursor->rows != NULL)
+    {
+        freeRowSet(cursor->rows);
+        free(cursor->rows);
+    }
+    free(cursor);
+}
+
+static int advanceTerm(RowCursor *cursor, int target)
+{
+    Posting first = makePosting(target, 0);
+    if (cursor->gallops)
+        cursor->position = gallop(cursor->postings, cursor->length, cursor->position, first);
+    else
+        while (cursor->position < cursor->length && cursor->postings[cursor->position] < first)
+            cursor->position++;
+    if (cursor->position == cursor->length)
+        return ROW_END;
+    return postingRow(cursor->postings[cursor->position]);
+}
+
+static int advanceSet(RowCursor *cursor, int target)
+{
+    unsigned int row;
+    if (!seekRowSet(cursor->rows, &cursor->container, &cursor->position, target, &row))
+        return ROW_END;
+    return row;
+}
+
+static int advanceAnd(RowCursor *cursor, int target)
+{
+    RowCursor **children = cursor->children;
+    int row = advanceRow(children[0], target);
+    int i = 1;
+    while (row != ROW_END && i < cursor->childCount)
+    {
+        int next = advanceRow(children[i], row);
+        if (next == row)
+            i++;
+        else
+        {
+            row = advanceRow(children[0], next);
+            i = 1;
+        }
+    }
+    return row;
+}
+
+static int advanceOr(RowCursor *cursor, int target)
+{
+    int row = ROW_END;
+    for (int i = 0; i < cursor->childCount; i++)
+    {
+        int next = advanceRow(cursor->children[i], target);
+        if (next < row)
+            row = next;
+    }
+    return row;
+}
+
+static int advanceNot(RowCursor *cursor, int target)
+{
+    int row = target;
+    while (row <= cursor->rowCount && advanceRow(cursor->children[0], row) == row)
+        row++;
+    return row <= cursor->rowCount ? row : ROW_END;
+}
+
+/* Moves cursor to its first row not below target and returns it. */
+int advanceRow(RowCursor *cursor, int target)
+{
+    if (cursor->row >= target)
+        return cursor->row;
+    if (cursor->kind == CURSOR_TERM)
+        cursor->row = advanceTerm(cursor, target);
+    else if (cursor->kind == CURSOR_SET)
+        cursor->row = advanceSet(cursor, target);
+    else if (cursor->kind == CURSOR_AND)
+        cursor->row = advanceAnd(cursor, target);
+    else if (cursor->kind == CURSOR_OR)
+        cursor->row = advanceOr(cursor, target);
+    else
+        cursor->row = advanceNot(cursor, target);
+    return cursor->row;
+}
+
+int nextRow(RowCursor *cursor)
+{
+    if (cursor->row == ROW_END)
+        return ROW_END;
+    return advanceRow(cursor, cursor->row + 1);
+}
+
+static int isOperator(const char *word, int len)
+{
+    return (len == 3 && (strncmp(word, "AND", 3) == 0 || strncmp(word, "NOT", 3) == 0)) ||
+           (len == 2 && strncmp(word, "OR", 2) == 0);
+}
+
+/* A query with parentheses or an AND, OR or NOT word is boolean. */
+int isBooleanQuery(const char *query)
+{
+    if (strpbrk(query, "()") != NULL)
+        return 1;
+    const char *p = query;
+    while (*p != '\0')
+    {
+        p += strspn(p, " \t");
+        int len = strcspn(p, " \t");
+        if (isOperator(p, len))
+            return 1;
+        p += len;
+    }
+    return 0;
+}
+
+/* Whether query is a phrase or proximity query for runQuery: it has
+ * several words but is not a boolean query. */
+int isPhraseQuery(const char *query)
+{
+    return strpbrk(query, " \t") != NULL && !isBooleanQuery(query);
+}
+
+struct QueryParser_
+{
+    StoredIndex *stored;
+    char **tokens;
+    int count;
+    int next;
+};
+
+typedef struct QueryParser_ QueryParser;
+
+static int nextIs(QueryParser *parser, const char *token)
+{
+    return parser->next < parser->count && strcmp(parser->tokens[parser->next], token) == 0;
+}
+
+/* The rows of term as a set, none if term is negative. */
+static RowCursor *rowsCursor(StoredIndex *stored, int term)
+{
+    RowSet *rows = malloc(sizeof(RowSet));
+    initRowSet(rows);
+    if (term >= 0)
+        readTermRows(stored, term, rows);
+    return makeSetCursor(rows);
+}
+
+/* The rows of a word, or for "word~" or "word~d" those of any term
+ * within that many edits of it. */
+static RowCursor *termCursor(StoredIndex *stored, const char *word)
+{
+    int len = strlen(word), wordLength, maxDistance;
+    if (parseFuzzyWord(word, len, &wordLength, &maxDistance))
+    {
+        FuzzyTerm *matches;
+        int count = findFuzzyTerms(stored, word, wordLength, maxDistance, &matches);
+        RowCursor *cursor;
+        if (count == 0)
+            cursor = rowsCursor(stored, -1);
+        else if (count == 1)
+            cursor = rowsCursor(stored, matches[0].term);
+        else
+        {
+            RowCursor **children = malloc(count * sizeof(RowCursor *));
+            for (int i = 0; i < count; i++)
+                children[i] = rowsCursor(stored, matches[i].term);
+            cursor = makeOrCursor(children, count);
+            free(children);
+        }
+        free(matches);
+        return cursor;
+    }
+    return rowsCursor(stored, findTerm(stored, word, len));
+}
+
+static RowCursor *parseOr(QueryParser *parser);
+
+/* operand: NOT operand | ( or ) | word */
+static RowCursor *parseOperand(QueryParser *parser)
+{
+    if (parser->next == parser->count)
+        return NULL;
+    char *token = parser->tokens[parser->next++];
+    if (strcmp(token, "NOT") == 0)
+    {
+        RowCursor *child = parseOperand(parser);
+        return child == NULL ? NULL : makeNotCursor(child, parser->stored->header->rowCount);
+    }
+    if (strcmp(token, "(") == 0)
+    {
+        RowCursor *inner = parseOr(parser);
+        if (inner != NULL && !nextIs(parser, ")"))
+        {
+            freeRowCursor(inner);
+            return NULL;
+        }
+        parser->next++;
+        return inner;
+    }
+    if (strcmp(token, ")") == 0 || isOperator(token, strlen(token)))
+        return NULL;
+    return termCursor(parser->stored, token);
+}
+
+/* and: operand [AND] operand ... ; or: and OR and ... */
+static RowCursor *parseList(QueryParser *parser, int kind)
+{
+    RowCursor *children[MAX_QUERY_WORDS];
+    int count = 0;
+    while (1)
+    {
+        RowCursor *child = kind == CURSOR_OR ? parseList(parser, CURSOR_AND) : parseOperand(parser);
+        if (child == NULL || count == MAX_QUERY_WORDS)
+        {
+            if (child != NULL)
+                freeRowCursor(child);
+            for (int i = 0; i < count; i++)
+                freeRowCursor(children[i]);
+            return NULL;
+        }
+        children[count++] = child;
+        if (kind == CURSOR_OR)
+        {
+            if (!nextIs(parser, "OR"))
+                break;
+            parser->next++;
+        }
+        else
+        {
+            if (parser->next == parser->count || nextIs(parser, ")") || nextIs(parser, "OR"))
+                break;
+            if (nextIs(parser, "AND"))
+                parser->next++;
+        }
+    }
+    if (count == 1)
+        return children[0];
+    return kind == CURSOR_OR ? makeOrCursor(children, count) : makeAndCursor(children, count, GALLOP_RATIO);
+}
+
+static RowCursor *parseOr(QueryParser *parser)
+{
+    return parseList(parser, CURSOR_OR);
+}
+
+/* Builds the cursor tree of a query made of words, AND, OR, NOT and
+ * parentheses. NOT binds tightest, then AND, which may be left out
+ * between two operands, then OR. Each word is read into a row set when
+ * the tree is built, and each AND intersects the sets among its operands
+ * then; the rest of the tree, ORs, NOTs and ANDs over them, streams its
+ * rows one nextRow at a time. Returns NULL if the query is malformed. */
+RowCursor *parseBooleanQuery(StoredIndex *stored, const char *query)
+{
+    int size = strlen(query);
+    char *text = malloc(2 * size + 2);
+    char **tokens = malloc((size + 1) * sizeof(char *));
+    int count = 0;
+    char *out = text;
+    for (const char *p = query; *p != '\0';)
+    {
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+        tokens[count++] = out;
+        if (*p == '(' || *p == ')')
+            *out++ = *p++;
+        else
+            while (*p != '\0' && strchr(" \t()", *p) == NULL)
+                *out++ = *p++;
+        *out++ = '\0';
+    }
+
+    QueryParser parser;
+    parser.stored = stored;
+    parser.tokens = tokens;
+    parser.count = count;
+    parser.next = 0;
+    RowCursor *cursor = parseOr(&parser);
+    if (cursor != NULL && parser.next != parser.count)
+    {
+        freeRowCursor(cursor);
+        cursor = NULL;
+    }
+    free(tokens);
+    free(text);
+    return cursor;
+}
@@ -0,0 +1,82 @@
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+#include <limits.h>
+
+#include "dict.h"
+#include "posting.h"
+#include "store.h"
+
+#define MAX_QUERY_WORDS 16
+
+#define CURSOR_TERM 0
+#define CURSOR_AND 1
+#define CURSOR_OR 2
+#define CURSOR_NOT 3
+#define CURSOR_SET 4
+
+/* The row a cursor reports once it has no more rows. */
+#define ROW_END INT_MAX
+
+/* An AND walks a list linearly unless it is this many times longer than
+ * the shortest operand, and gallops through it otherwise. */
+#define GALLOP_RATIO 512
+
+/* The places a query matches: the position of the first field of every
+ * match, in (row, col) order. Each match covers width consecutive fields
+ * of its row. */
+struct MatchList_
+{
+    Posting *items;
+    int length;
+    int width;
+};
+
+typedef struct MatchList_ MatchList;
+
+/* A stream of the rows matching a boolean query, produced in increasing
+ * order on demand. row is the current row: 0 before the first call,
+ * ROW_END after the last one. cost bounds the number of rows it can
+ * produce and decides the order in which an AND visits its operands.
+ * The words of a query are row sets; an AND intersects those among its
+ * operands when it is made, and walks the result with the others. */
+struct RowCursor_
+{
+    int kind;
+    int row;
+    long cost;
+    Posting *postings; /* CURSOR_TERM */
+    int length;
+    int position; /* and CURSOR_SET */
+    int gallops;
+    RowSet *rows; /* CURSOR_SET */
+    int container;
+    struct RowCursor_ **children; /* the other kinds */
+    int childCount;
+    int rowCount; /* CURSOR_NOT */
+};
+
+typedef struct RowCursor_ RowCursor;
+
+void freeMatchList(MatchList *matches);
+
+int gallop(const Posting *items, int length, int from, Posting target);
+void matchPhrase(Posting **lists, int *lengths, int *offsets, int count, int width, MatchList *out);
+void matchNear(MatchList *left, MatchList *right, int distance, MatchList *out);
+
+int runQuery(StoredIndex *stored, Dict *stopWords, const char *query, MatchList *out);
+
+RowCursor *makeTermCursor(Posting *postings, int length);
+RowCursor *makeSetCursor(RowSet *rows);
+RowCursor *makeAndCursor(RowCursor **children, int count, int gallopRatio);
+RowCursor *makeOrCursor(RowCursor **children, int count);
+RowCursor *makeNotCursor(RowCursor *child, int rowCount);
+void freeRowCursor(RowCursor *cursor);
+int advanceRow(RowCursor *cursor, int target);
+int nextRow(RowCursor *cursor);
+
+int isBooleanQuery(const char *query);
+int isPhraseQuery(const char *query);
+RowCursor *parseBooleanQuery(StoredIndex *stored, const char *query);
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rank.h"
+#include "query.h"
+
+/* The weight BM25 gives a word found frequency times in a row of length
+ * words, before its idf. It grows with frequency towards BM25_K1 + 1 and
+ * shrinks as the row gets longer than average. */
+double bm25Weight(int frequency, int length, double averageLength)
+{
+    if (frequency > BM25_MAX_FREQUENCY)
+        frequency = BM25_MAX_FREQUENCY;
+    double norm = BM25_K1 * (1 - BM25_B + BM25_B * length / averageLength);
+    return frequency * (BM25_K1 + 1) / (frequency + norm);
+}
+
+/* A ranked query is "RANK/k" followed by its words. */
+int isRankQuery(const char *query)
+{
+    return strncmp(query, RANK_OPERATOR, strlen(RANK_OPERATOR)) == 0;
+}
+
+/* Whether a ranks below b: a lower score, or the same one on a later
+ * row. */
+static int rankedBelow(const RankedRow *a, const RankedRow *b)
+{
+    return a->score != b->score ? a->score < b->score : a->row > b->row;
+}
+
+static void siftRankedDown(RankedRow *top, int size, int i)
+{
+    while (1)
+    {
+        int worst = i;
+        int left = 2 * i + 1, right = left + 1;
+        if (left < size && rankedBelow(&top[left], &top[worst]))
+            worst = left;
+        if (right < size && rankedBelow(&top[right], &top[worst]))
+            worst = right;
+        if (worst == i)
+            return;
+        RankedRow t = top[i];
+        top[i] = top[worst];
+        top[worst] = t;
+        i = worst;
+    }
+}
+
+/* Keeps the k best rows offered so far in top, a heap with the worst of
+ * them first. */
+static void offerRow(RankedRow *top, int *size, int k, unsigned int row, double score)
+{
+    RankedRow candidate = {row, score};
+    if (*size < k)
+    {
+        int i = (*size)++;
+        top[i] = candidate;
+        while (i > 0 && rankedBelow(&top[i], &top[(i - 1) / 2]))
+        {
+            RankedRow t = top[i];
+            top[i] = top[(i - 1) / 2];
+            top[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    }
+    else if (k > 0 && rankedBelow(&top[0], &candidate))
+    {
+        top[0] = candidate;
+        siftRankedDown(top, *size, 0);
+    }
+}
+
+/* Moves scorer to its first row at or after target. */
+static void moveScorer(TermScorer *scorer, int target)
+{
+    scorer->position = gallop(scorer->postings, scorer->length, scorer->position, makePosting(target, 0));
+    scorer->row = scorer->position < scorer->length ? postingRow(scorer->postings[scorer->position]) : ROW_END;
+}
+
+/* What the term adds to the score of its current row, which it then
+ * moves past. */
+static double scoreRow(TermScorer *scorer, StoredIndex *stored, double averageLength)
+{
+    int frequency = 0;
+    while (scorer->position < scorer->length && postingRow(scorer->postings[scorer->position]) == scorer->row)
+    {
+        scorer->position++;
+        frequency++;
+    }
+    /* a row past those of the index has no length stored, as in
+     * fillRankingStatistics */
+    unsigned int row = scorer->row;
+    int length = row >= 1 && row <= stored->header->rowCount ? stored->rowLengths[row - 1] : frequency;
+    double weight = scorer->idf * bm25Weight(frequency, length, averageLength);
+    scorer->row = scorer->position < scorer->length ? postingRow(scorer->postings[scorer->position]) : ROW_END;
+    return weight;
+}
+
+static void sortScorers(TermScorer **scorers, int count)
+{
+    for (int i = 1; i < count; i++)
+    {
+        TermScorer *scorer = scorers[i];
+        int j = i;
+        for (; j > 0 && scorers[j - 1]->row > scorer->row; j--)
+            scorers[j] = scorers[j - 1];
+        scorers[j] = scorer;
+    }
+}
+
+/* The full score of row, added up in query word order whatever order
+ * the scorers are visited in, so that equal rows tie exactly. */
+static double scoreAt(TermScorer *scorers, int count, int row, StoredIndex *stored, double averageLength)
+{
+    double score = 0;
+    for (int i = 0; i < count; i++)
+        if (scorers[i].row == row)
+            score += scoreRow(&scorers[i], stored, averageLength);
+    return score;
+}
+
+/* Scores every row any scorer has. */
+static void scoreAll(TermScorer *scorers, int count, StoredIndex *stored, double averageLength,
+                     unsigned int rowBase, RankedRow *top, int *size, int k, long *scored)
+{
+    while (1)
+    {
+        int row = ROW_END;
+        for (int i = 0; i < count; i++)
+            if (scorers[i].row < row)
+                row = scorers[i].row;
+        if (row == ROW_END)
+            return;
+        (*scored)++;
+        offerRow(top, size, k, rowBase + row, scoreAt(scorers, count, row, stored, averageLength));
+    }
+}
+
+/* WAND (Broder et al.): with the scorers in row order, the pivot is the
+ * first one at which their bounds add up to more than the worst score
+ * kept, which the rows before the pivot's row cannot reach, as only the
+ * scorers before it have them. If the first scorer is already on the
+ * pivot row that row is scored in full; otherwise the scorers before
+ * the pivot gallop to it, skipping their rows unscored. order holds
+ * the scorers, kept sorted by row. */
+static void scorePruned(TermScorer *scorers, TermScorer **order, int count, StoredIndex *stored,
+                        double averageLength, unsigned int rowBase, RankedRow *top, int *size, int k, long *scored)
+{
+    while (1)
+    {
+        sortScorers(order, count);
+        double threshold = *size == k ? top[0].score : 0;
+        double bounds = 0;
+        int pivot = -1;
+        for (int i = 0; i < count && order[i]->row != ROW_END; i++)
+        {
+            bounds += order[i]->bound;
+            if (bounds > threshold)
+            {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot < 0)
+            return;
+        int row = order[pivot]->row;
+        if (order[0]->row == row)
+        {
+            (*scored)++;
+            offerRow(top, size, k, rowBase + row, scoreAt(scorers, count, row, stored, averageLength));
+        }
+        else
+        {
+            for (int i = 0; i < pivot; i++)
+                if (order[i]->row < row)
+                    moveScorer(order[i], row);
+        }
+    }
+}
+
+/* Stores in top the k rows of set that score highest by BM25 for the
+ * count words, best first, and returns how many there are. Every row
+ * is scored if exhaustive is set, otherwise WAND skips those that cannot
+ * make it; both give the same rows. Row counts, lengths and the number
+ * of rows holding a word are those of the whole set, so a segmented
+ * index ranks as the same index in one file. A term's bound is the
+ * weight of its best row at its segment's average row length, exact
+ * when that is the average of the set. Otherwise it is only a bound:
+ * with a longer average every weight grows by at most the ratio of the
+ * two, so the bound is scaled by it, and with a shorter one no weight
+ * grows. The rows fully scored are added to scored. */
+int rankRows(SegmentSet *set, char **words, int count, int k, int exhaustive, RankedRow *top, long *scored)
+{
+    unsigned long long tokenCount = 0;
+    for (int s = 0; s < set->count; s++)
+        tokenCount += set->segments[s].header->tokenCount;
+    double averageLength = set->rowCount > 0 && tokenCount > 0 ? (double)tokenCount / set->rowCount : 1;
+
+    double *idfs = malloc((count + 1) * sizeof(double));
+    for (int w = 0; w < count; w++)
+    {
+        unsigned int rows = 0;
+        for (int s = 0; s < set->count; s++)
+        {
+            int term = findTerm(&set->segments[s], words[w], strlen(words[w]));
+            if (term >= 0)
+                rows += set->segments[s].terms[term].rowCount;
+        }
+        idfs[w] = log(1 + (set->rowCount - rows + 0.5) / (rows + 0.5));
+    }
+
+    TermScorer *scorers = malloc((count + 1) * sizeof(TermScorer));
+    TermScorer **active = malloc((count + 1) * sizeof(TermScorer *));
+    int size = 0;
+    for (int s = 0; s < set->count; s++)
+    {
+        StoredIndex *stored = &set->segments[s];
+        double segmentAverage = stored->header->rowCount > 0 && stored->header->tokenCount > 0
+                                    ? (double)stored->header->tokenCount / stored->header->rowCount
+                                    : 1;
+        int activeCount = 0;
+        for (int w = 0; w < count; w++)
+        {
+            int term = findTerm(stored, words[w], strlen(words[w]));
+            if (term < 0)
+                continue;
+            TermScorer *scorer = &scorers[activeCount];
+            TermEntry *entry = &stored->terms[term];
+            scorer->length = entry->postingCount;
+            scorer->postings = malloc((scorer->length + 1) * sizeof(Posting));
+            readTermPostings(stored, term, scorer->postings);
+            scorer->position = 0;
+            scorer->row = scorer->length > 0 ? postingRow(scorer->postings[0]) : ROW_END;
+            scorer->idf = idfs[w];
+            if (segmentAverage == averageLength)
+                scorer->bound = idfs[w] * bm25Weight(entry->boundFrequency, entry->boundLength, averageLength);
+            else
+                /* a little over the ratio, for rounding */
+                scorer->bound = idfs[w] * bm25Weight(entry->boundFrequency, entry->boundLength, segmentAverage) *
+                                (averageLength > segmentAverage ? averageLength / segmentAverage : 1) * (1 + 1e-9);
+            active[activeCount++] = scorer;
+        }
+        if (exhaustive)
+            scoreAll(scorers, activeCount, stored, averageLength, set->rowBases[s], top, &size, k, scored);
+        else
+            scorePruned(scorers, active, activeCount, stored, averageLength, set->rowBases[s], top, &size, k, scored);
+        for (int a = 0; a < activeCount; a++)
+            free(scorers[a].postings);
+    }
+    free(active);
+    free(scorers);
+    free(idfs);
+
+    /* the heap, worst first, into best first order */
+    for (int end = size - 1; end > 0; end--)
+    {
+        RankedRow t = top[0];
+        top[0] = top[end];
+        top[end] = t;
+        siftRankedDown(top, end, 0);
+    }
+    return size;
+}
+
+/* Answers "RANK/k word..." with its k best rows in top, which must have
+ * room for MAX_RANK_COUNT, and their number in count. Returns IO_ERROR
+ * if the query is malformed. */
+int runRankQuery(SegmentSet *set, const char *query, RankedRow *top, int *count)
+{
+    char *end;
+    long k = strtol(query + strlen(RANK_OPERATOR), &end, 10);
+    if ((*end != ' ' && *end != '\t') || k < 1 || k > MAX_RANK_COUNT)
+        return IO_ERROR;
+
+    char *text = strdup(end);
+    char *words[MAX_QUERY_WORDS];
+    int wordCount = 0;
+    char *save;
+    for (char *word = strtok_r(text, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+    {
+        if (wordCount == MAX_QUERY_WORDS)
+        {
+            free(text);
+            return IO_ERROR;
+        }
+        words[wordCount++] = word;
+    }
+    long scored = 0;
+    if (wordCount > 0)
+        *count = rankRows(set, words, wordCount, k, 0, top, &scored);
+    free(text);
+    return wordCount > 0 ? IO_SUCCESS : IO_ERROR;
+}
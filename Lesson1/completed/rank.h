@@ -0,0 +1,47 @@
+#ifndef __RANK_H__
+#define __RANK_H__
+
+#include "segment.h"
+
+/* Okapi BM25 with the usual parameters. The rows of the index are what
+ * it ranks: they are the unit boolean queries return, and a corpus of a
+ * few files has too few documents to rank. */
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+/* Frequencies are counted up to this, the most the bound of a TermEntry
+ * holds, both there and when rows are scored, so a bound is never below
+ * a score. Row lengths are stored up to it already. */
+#define BM25_MAX_FREQUENCY 65535
+
+#define RANK_OPERATOR "RANK/"
+#define MAX_RANK_COUNT 1000
+
+struct RankedRow_
+{
+    unsigned int row;
+    double score;
+};
+
+typedef struct RankedRow_ RankedRow;
+
+/* The rows of one query term in one segment, visited in order. bound is
+ * the most the term adds to the score of any of them. */
+struct TermScorer_
+{
+    Posting *postings;
+    int length;
+    int position;
+    int row; /* ROW_END after the last */
+    double idf;
+    double bound;
+};
+
+typedef struct TermScorer_ TermScorer;
+
+double bm25Weight(int frequency, int length, double averageLength);
+int isRankQuery(const char *query);
+int rankRows(SegmentSet *set, char **words, int count, int k, int exhaustive, RankedRow *top, long *scored);
+int runRankQuery(SegmentSet *set, const char *query, RankedRow *top, int *k);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+
+#include "rowset.h"
+
+void initRowSet(RowSet *set)
+{
+    set->containers = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->rowCount = 0;
+}
+
+void freeRowSet(RowSet *set)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        free(set->containers[i].array);
+        free(set->containers[i].bitmap);
+    }
+    free(set->containers);
+    initRowSet(set);
+}
+
+/* Appends an empty array container for key. */
+static RowContainer *pushContainer(RowSet *set, unsigned int key)
+{
+    if (set->count == set->capacity)
+    {
+        set->capacity = set->capacity == 0 ? 4 : set->capacity * 2;
+        set->containers = realloc(set->containers, set->capacity * sizeof(RowContainer));
+    }
+    RowContainer *container = &set->containers[set->count++];
+    container->key = key;
+    container->count = 0;
+    container->capacity = 0;
+    container->array = NULL;
+    container->bitmap = NULL;
+    return container;
+}
+
+/* Turns a full array container into a bitmap one. */
+static void makeBitmap(RowContainer *container)
+{
+    container->bitmap = calloc(ROWSET_BITMAP_WORDS, sizeof(unsigned long long));
+    for (int i = 0; i < container->count; i++)
+        container->bitmap[container->array[i] >> 6] |= 1ULL << (container->array[i] & 63);
+    free(container->array);
+    container->array = NULL;
+    container->capacity = 0;
+}
+
+/* Adds row, which must not be below any row added before; adding the
+ * last one again does nothing. */
+void addRow(RowSet *set, unsigned int row)
+{
+    unsigned int key = row >> ROWSET_CHUNK_BITS;
+    unsigned int low = row & (ROWSET_CHUNK_ROWS - 1);
+    RowContainer *container = set->count > 0 ? &set->containers[set->count - 1] : NULL;
+    if (container == NULL || container->key != key)
+        container = pushContainer(set, key);
+    if (container->bitmap == NULL)
+    {
+        if (container->count > 0 && container->array[container->count - 1] == low)
+            return;
+        if (container->count == ROWSET_ARRAY_MAX)
+            makeBitmap(container);
+    }
+    if (container->bitmap != NULL)
+    {
+        unsigned long long bit = 1ULL << (low & 63);
+        if (container->bitmap[low >> 6] & bit)
+            return;
+        container->bitmap[low >> 6] |= bit;
+    }
+    else
+    {
+        if (container->count == container->capacity)
+        {
+            container->capacity = container->capacity == 0 ? 4 : container->capacity * 2;
+            container->array = realloc(container->array, container->capacity * sizeof(unsigned short));
+        }
+        container->array[container->count] = low;
+    }
+    container->count++;
+    set->rowCount++;
+}
+
+/* Bytes the set takes in memory. */
+long rowSetBytes(const RowSet *set)
+{
+    long bytes = sizeof(RowSet) + set->capacity * sizeof(RowContainer);
+    for (int i = 0; i < set->count; i++)
+    {
+        const RowContainer *container = &set->containers[i];
+        if (container->bitmap != NULL)
+            bytes += ROWSET_BITMAP_WORDS * sizeof(unsigned long long);
+        else
+            bytes += container->capacity * sizeof(unsigned short);
+    }
+    return bytes;
+}
+
+/* The first index from from on at which array holds at least value,
+ * found by doubling steps and then halving them. */
+static int searchArray(const unsigned short *array, int count, int from, unsigned int value)
+{
+    int step = 1, low = from, high = from;
+    while (high < count && array[high] < value)
+    {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    if (high > count)
+        high = count;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (array[mid] < value)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/* Finds the first row of set not below target, looking from container
+ * and position on, which a caller keeps between calls going up: for an
+ * array container position indexes the array, for a bitmap it is the
+ * low bits of the row. Stores the row and returns 1, or returns 0 if
+ * there is none. */
+int seekRowSet(const RowSet *set, int *container, int *position, unsigned int target, unsigned int *row)
+{
+    unsigned int key = target >> ROWSET_CHUNK_BITS;
+    int c = *container, p = *position;
+    for (; c < set->count; c++, p = 0)
+    {
+        const RowContainer *current = &set->containers[c];
+        if (current->key < key)
+            continue;
+        unsigned int low = current->key == key ? target & (ROWSET_CHUNK_ROWS - 1) : 0;
+        if (current->bitmap == NULL)
+        {
+            p = searchArray(current->array, current->count, p, low);
+            if (p == current->count)
+                continue;
+            *row = current->key << ROWSET_CHUNK_BITS | current->array[p];
+        }
+        else
+        {
+            if ((int)low < p)
+                low = p;
+            int w = low >> 6;
+            unsigned long long word = current->bitmap[w] & (~0ULL << (low & 63));
+            while (word == 0 && ++w < ROWSET_BITMAP_WORDS)
+                word = current->bitmap[w];
+            if (word == 0)
+                continue;
+            p = w * 64 + __builtin_ctzll(word);
+            *row = current->key << ROWSET_CHUNK_BITS | p;
+        }
+        *container = c;
+        *position = p;
+        return 1;
+    }
+    *container = c;
+    *position = 0;
+    return 0;
+}
+
+/* The kernels below write every candidate and advance the output by a
+ * comparison instead of branching on it, so that their loops run
+ * without mispredicted branches and, for bitmaps, vectorise. */
+
+static int intersectArrays(const unsigned short *a, int aCount, const unsigned short *b, int bCount,
+                           unsigned short *out)
+{
+    int n = 0;
+    if ((long)aCount * ROWSET_SEARCH_RATIO < bCount || (long)bCount * ROWSET_SEARCH_RATIO < aCount)
+    {
+        if (aCount > bCount)
+        {
+            const unsigned short *t = a;
+            a = b;
+            b = t;
+            int c = aCount;
+            aCount = bCount;
+            bCount = c;
+        }
+        int j = 0;
+        for (int i = 0; i < aCount && j < bCount; i++)
+        {
+            j = searchArray(b, bCount, j, a[i]);
+            out[n] = a[i];
+            n += j < bCount && b[j] == a[i];
+        }
+        return n;
+    }
+    int i = 0, j = 0;
+    while (i < aCount && j < bCount)
+    {
+        unsigned short x = a[i], y = b[j];
+        out[n] = x;
+        n += x == y;
+        i += x <= y;
+        j += y <= x;
+    }
+    return n;
+}
+
+static int intersectArrayBitmap(const unsigned short *array, int count, const unsigned long long *bitmap,
+                                unsigned short *out)
+{
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned short value = array[i];
+        out[n] = value;
+        n += (bitmap[value >> 6] >> (value & 63)) & 1;
+    }
+    return n;
+}
+
+static int intersectBitmaps(const unsigned long long *restrict a, const unsigned long long *restrict b,
+                            unsigned long long *restrict out)
+{
+    int n = 0;
+    for (int w = 0; w < ROWSET_BITMAP_WORDS; w++)
+        out[w] = a[w] & b[w];
+    for (int w = 0; w < ROWSET_BITMAP_WORDS; w++)
+        n += __builtin_popcountll(out[w]);
+    return n;
+}
+
+/* Fills out, a container for the key of a and b, with the rows in
+ * both, as an array if there are few enough of them. */
+static void intersectContainers(const RowContainer *a, const RowContainer *b, RowContainer *out)
+{
+    if (a->bitmap != NULL && b->bitmap != NULL)
+    {
+        unsigned long long *bitmap = malloc(ROWSET_BITMAP_WORDS * sizeof(unsigned long long));
+        out->count = intersectBitmaps(a->bitmap, b->bitmap, bitmap);
+        if (out->count > ROWSET_ARRAY_MAX)
+        {
+            out->bitmap = bitmap;
+            return;
+        }
+        out->array = malloc((out->count + 1) * sizeof(unsigned short));
+        out->capacity = out->count;
+        int n = 0;
+        for (int w = 0; w < ROWSET_BITMAP_WORDS; w++)
+            for (unsigned long long word = bitmap[w]; word != 0; word &= word - 1)
+                out->array[n++] = w * 64 + __builtin_ctzll(word);
+        free(bitmap);
+        return;
+    }
+    if (a->bitmap != NULL)
+    {
+        const RowContainer *t = a;
+        a = b;
+        b = t;
+    }
+    out->array = malloc((a->count + 1) * sizeof(unsigned short));
+    out->capacity = a->count;
+    if (b->bitmap != NULL)
+        out->count = intersectArrayBitmap(a->array, a->count, b->bitmap, out->array);
+    else
+        out->count = intersectArrays(a->array, a->count, b->array, b->count, out->array);
+}
+
+/* Stores the rows in both a and b in out, an initialised empty set,
+ * chunk by chunk. */
+void intersectRowSets(const RowSet *a, const RowSet *b, RowSet *out)
+{
+    int i = 0, j = 0;
+    while (i < a->count && j < b->count)
+    {
+        const RowContainer *x = &a->containers[i], *y = &b->containers[j];
+        if (x->key < y->key)
+            i++;
+        else if (y->key < x->key)
+            j++;
+        else
+        {
+            RowContainer *container = pushContainer(out, x->key);
+            intersectContainers(x, y, container);
+            if (container->count == 0)
+            {
+                free(container->array);
+                free(container->bitmap);
+                out->count--;
+            }
+            else
+                out->rowCount += container->count;
+            i++;
+            j++;
+        }
+    }
+}
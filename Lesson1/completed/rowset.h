@@ -0,0 +1,51 @@
+#ifndef __ROWSET_H__
+#define __ROWSET_H__
+
+/* A set of rows split, as in Roaring bitmaps (Chambi et al.), into
+ * chunks of ROWSET_CHUNK_ROWS by their high bits. A chunk with at most
+ * ROWSET_ARRAY_MAX rows keeps their low bits in a sorted array, two
+ * bytes a row; a fuller one is a bitmap of ROWSET_BITMAP_WORDS words,
+ * which is smaller from there on. So a rare term costs two bytes a row
+ * and one in most rows an eighth of a byte, where a decoded position
+ * list costs eight bytes an occurrence. */
+#define ROWSET_CHUNK_BITS 16
+#define ROWSET_CHUNK_ROWS (1 << ROWSET_CHUNK_BITS)
+#define ROWSET_ARRAY_MAX 4096
+#define ROWSET_BITMAP_WORDS (ROWSET_CHUNK_ROWS / 64)
+
+/* Two arrays this many times apart in size are intersected by searching
+ * the longer one for each row of the shorter. */
+#define ROWSET_SEARCH_RATIO 32
+
+/* The rows of one chunk: in array while there are at most
+ * ROWSET_ARRAY_MAX of them, in bitmap, which is NULL until then,
+ * afterwards. */
+struct RowContainer_
+{
+    unsigned int key; /* row >> ROWSET_CHUNK_BITS */
+    int count;
+    int capacity; /* of array */
+    unsigned short *array;
+    unsigned long long *bitmap;
+};
+
+typedef struct RowContainer_ RowContainer;
+
+struct RowSet_
+{
+    RowContainer *containers; /* in key order */
+    int count;
+    int capacity;
+    long rowCount;
+};
+
+typedef struct RowSet_ RowSet;
+
+void initRowSet(RowSet *set);
+void freeRowSet(RowSet *set);
+void addRow(RowSet *set, unsigned int row);
+long rowSetBytes(const RowSet *set);
+int seekRowSet(const RowSet *set, int *container, int *position, unsigned int target, unsigned int *row);
+void intersectRowSets(const RowSet *a, const RowSet *b, RowSet *out);
+
+#endif
@@ -0,0 +1,670 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "segment.h"
+#include "spimi.h"
+#include "output.h"
+
+/* How many times openSegmentSet reads the manifest again when a segment
+ * it lists has been merged away in the meantime. */
+#define SEGMENT_OPEN_ATTEMPTS 3
+
+#define MERGE_COUNT 0
+#define MERGE_TERMS 1
+#define MERGE_KEYS 2
+#define MERGE_POSTINGS 3
+
+/* The segments being merged into one file, and the state of one pass of
+ * the k-way merge over their term tables. A merge makes four passes: one
+ * to size the sections and build the automaton, then one to write each
+ * of the term table, the keys and the postings, in file order. */
+struct SegmentMerge_
+{
+    StoredIndex *segments;
+    unsigned int *rowBases;
+    int count;
+    unsigned int *positions;
+    int *heap;
+    int *group;
+    OutputWriter *out;
+    FstBuilder *fst;
+    unsigned long long *termSizes; /* of each merged term, from the first pass */
+    unsigned int termCapacity;
+    unsigned int wordCount;
+    unsigned int keyOffset;
+    unsigned long long postingOffset;
+};
+
+typedef struct SegmentMerge_ SegmentMerge;
+
+static char *segmentPath(char *dir, const char *name)
+{
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+int isSegmentDirectory(char *path)
+{
+    struct stat status;
+    return stat(path, &status) == 0 && S_ISDIR(status.st_mode);
+}
+
+/* The file whose replacement means the index at path has changed: the
+ * manifest of a segment directory, or the index file itself. */
+char *watchedPath(char *path)
+{
+    return isSegmentDirectory(path) ? segmentPath(path, SEGMENT_MANIFEST) : strdup(path);
+}
+
+/* Opens dir/name and takes an flock on it; returns the descriptor, to be
+ * closed to let go of the lock, or -1. */
+static int lockFile(char *dir, const char *name, int operation)
+{
+    char *path = segmentPath(dir, name);
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    free(path);
+    if (fd >= 0 && flock(fd, operation) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* The manifest is a text file:
+ *   KPLSEGS1 next ingested written count
+ * then one line per segment, oldest rows first:
+ *   name first last size */
+int readManifest(char *dir, Manifest *manifest)
+{
+    memset(manifest, 0, sizeof(Manifest));
+    char *path = segmentPath(dir, SEGMENT_MANIFEST);
+    FILE *fp = fopen(path, "r");
+    free(path);
+    if (fp == NULL)
+        return IO_ERROR;
+    char magic[16];
+    int count;
+    int ok = fscanf(fp, "%15s %u %llu %llu %d", magic, &manifest->next, &manifest->ingested,
+                    &manifest->written, &count) == 5 &&
+             strcmp(magic, SEGMENT_MAGIC) == 0 && count >= 0;
+    if (ok)
+        manifest->segments = malloc((count + 1) * sizeof(SegmentInfo));
+    for (int s = 0; ok && s < count; s++)
+    {
+        SegmentInfo *info = &manifest->segments[s];
+        ok = fscanf(fp, "%31s %u %u %llu", info->name, &info->first, &info->last, &info->size) == 4;
+        manifest->count += ok;
+    }
+    fclose(fp);
+    if (!ok)
+        freeManifest(manifest);
+    return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+void freeManifest(Manifest *manifest)
+{
+    free(manifest->segments);
+    memset(manifest, 0, sizeof(Manifest));
+}
+
+/* Replaces the manifest of dir with a rename, like an index file, so a
+ * reader sees either the old list or the new one. */
+static int writeManifest(char *dir, Manifest *manifest)
+{
+    char *path = segmentPath(dir, SEGMENT_MANIFEST);
+    char *tempPath;
+    FILE *fp = createIndexFile(path, &tempPath);
+    int status = IO_ERROR;
+    if (fp != NULL)
+    {
+        fprintf(fp, "%s %u %llu %llu %d\n", SEGMENT_MAGIC, manifest->next, manifest->ingested,
+                manifest->written, manifest->count);
+        for (int s = 0; s < manifest->count; s++)
+        {
+            SegmentInfo *info = &manifest->segments[s];
+            fprintf(fp, "%s %u %u %llu\n", info->name, info->first, info->last, info->size);
+        }
+        status = publishIndexFile(fp, path, tempPath, 1);
+    }
+    free(path);
+    return status;
+}
+
+static int segmentTier(unsigned long long size)
+{
+    int tier = 0;
+    for (unsigned long long limit = SEGMENT_TIER_BYTES; size >= limit; limit *= SEGMENT_MERGE_FACTOR)
+        tier++;
+    return tier;
+}
+
+/* The tiered merge policy: the lowest tier that has SEGMENT_MERGE_FACTOR
+ * neighbouring segments gets the oldest of them merged into one, which
+ * lands about a tier higher. Only neighbours are merged, so the segments
+ * stay in row order. Returns how many segments to merge from *first, or
+ * 0 if nothing needs merging. Each byte is then rewritten about once per
+ * tier, a logarithmic number of times. */
+int pickMerge(Manifest *manifest, int *first)
+{
+    int bestTier = -1;
+    for (int s = 0; s + SEGMENT_MERGE_FACTOR <= manifest->count; s++)
+    {
+        int tier = segmentTier(manifest->segments[s].size);
+        int run = 1;
+        while (run < SEGMENT_MERGE_FACTOR && segmentTier(manifest->segments[s + run].size) == tier)
+            run++;
+        if (run == SEGMENT_MERGE_FACTOR && (bestTier < 0 || tier < bestTier))
+        {
+            bestTier = tier;
+            *first = s;
+        }
+    }
+    return bestTier < 0 ? 0 : SEGMENT_MERGE_FACTOR;
+}
+
+static void closeSegments(StoredIndex *segments, int count)
+{
+    for (int s = 0; s < count; s++)
+        closeIndexFile(&segments[s]);
+}
+
+/* Opens the segment files in paths, in order, and fills in where the
+ * rows of each start in their concatenation. */
+static int openSegments(char **paths, int count, StoredIndex *segments, unsigned int *rowBases)
+{
+    unsigned int rowCount = 0;
+    for (int s = 0; s < count; s++)
+    {
+        if (openIndexFile(paths[s], &segments[s]) == IO_ERROR)
+        {
+            closeSegments(segments, s);
+            return IO_ERROR;
+        }
+        rowBases[s] = rowCount;
+        rowCount += segments[s].header->rowCount;
+    }
+    return IO_SUCCESS;
+}
+
+/* Opens an index for queries: all the segments its manifest lists if
+ * path is a segment directory, or the index file at path. */
+int openSegmentSet(char *path, SegmentSet *set)
+{
+    memset(set, 0, sizeof(SegmentSet));
+    int status = IO_ERROR;
+    if (!isSegmentDirectory(path))
+    {
+        set->count = 1;
+        set->segments = malloc(sizeof(StoredIndex));
+        set->rowBases = malloc(sizeof(unsigned int));
+        status = openSegments(&path, 1, set->segments, set->rowBases);
+    }
+    else
+    {
+        for (int attempt = 0; attempt < SEGMENT_OPEN_ATTEMPTS && status == IO_ERROR; attempt++)
+        {
+            Manifest manifest;
+            if (readManifest(path, &manifest) == IO_ERROR)
+                break;
+            set->count = manifest.count;
+            set->segments = realloc(set->segments, (set->count + 1) * sizeof(StoredIndex));
+            set->rowBases = realloc(set->rowBases, (set->count + 1) * sizeof(unsigned int));
+            char **paths = malloc((set->count + 1) * sizeof(char *));
+            for (int s = 0; s < set->count; s++)
+                paths[s] = segmentPath(path, manifest.segments[s].name);
+            status = openSegments(paths, set->count, set->segments, set->rowBases);
+            for (int s = 0; s < set->count; s++)
+                free(paths[s]);
+            free(paths);
+            freeManifest(&manifest);
+        }
+    }
+    if (status == IO_ERROR)
+    {
+        free(set->segments);
+        free(set->rowBases);
+        memset(set, 0, sizeof(SegmentSet));
+        return IO_ERROR;
+    }
+
+    for (int s = 0; s < set->count; s++)
+        set->docCount += set->segments[s].header->docCount;
+    set->docFirstRows = malloc((set->docCount + 1) * sizeof(unsigned int));
+    int doc = 0;
+    for (int s = 0; s < set->count; s++)
+    {
+        StoredIndex *stored = &set->segments[s];
+        for (unsigned int d = 0; d < stored->header->docCount; d++)
+            set->docFirstRows[doc++] = set->rowBases[s] + stored->docFirstRows[d];
+        set->rowCount = set->rowBases[s] + stored->header->rowCount;
+    }
+    return IO_SUCCESS;
+}
+
+void closeSegmentSet(SegmentSet *set)
+{
+    closeSegments(set->segments, set->count);
+    free(set->segments);
+    free(set->rowBases);
+    free(set->docFirstRows);
+    memset(set, 0, sizeof(SegmentSet));
+}
+
+/* Indexes the files in paths into a new segment at the end of the index
+ * in dir, creating the directory if needed. The segment is written by
+ * the bounded memory builder within budget bytes. Appends hold the
+ * manifest lock throughout, so they are numbered in order; a merge only
+ * waits for it to swap in its result. */
+int appendSegment(char *dir, char **paths, int pathCount, Dict *stopWords, int threads, long budget)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+        return IO_ERROR;
+    int lock = lockFile(dir, SEGMENT_LOCK, LOCK_EX);
+    if (lock < 0)
+        return IO_ERROR;
+
+    Manifest manifest;
+    char *manifestPath = segmentPath(dir, SEGMENT_MANIFEST);
+    int status = IO_SUCCESS;
+    if (access(manifestPath, F_OK) != 0)
+        memset(&manifest, 0, sizeof(Manifest));
+    else
+        status = readManifest(dir, &manifest);
+    free(manifestPath);
+
+    SegmentInfo info;
+    memset(&info, 0, sizeof(info));
+    info.first = info.last = manifest.next;
+    snprintf(info.name, sizeof(info.name), "%08u-%08u.seg", info.first, info.last);
+    char *path = segmentPath(dir, info.name);
+    if (status == IO_SUCCESS)
+        status = buildIndexFile(path, paths, pathCount, stopWords, threads, budget > 0 ? budget : SEGMENT_APPEND_BUDGET);
+
+    StoredIndex stored;
+    if (status == IO_SUCCESS && openIndexFile(path, &stored) == IO_SUCCESS)
+    {
+        info.size = stored.header->fileSize;
+        if (stored.header->docCount == 0)
+            status = IO_ERROR;
+        closeIndexFile(&stored);
+    }
+    else
+        status = IO_ERROR;
+
+    if (status == IO_SUCCESS)
+    {
+        manifest.segments = realloc(manifest.segments, (manifest.count + 1) * sizeof(SegmentInfo));
+        manifest.segments[manifest.count++] = info;
+        manifest.next++;
+        manifest.ingested += info.size;
+        manifest.written += info.size;
+        status = writeManifest(dir, &manifest);
+    }
+    if (status == IO_ERROR)
+        remove(path);
+    free(path);
+    freeManifest(&manifest);
+    close(lock);
+    return status;
+}
+
+/* The encoded size of the postings of a term: up to those of the next
+ * term, or to the automaton after the last one. */
+static unsigned long long encodedTermSize(StoredIndex *stored, unsigned int term)
+{
+    unsigned long long end = term + 1 < stored->header->wordCount
+                                 ? stored->terms[term + 1].postingOffset
+                                 : stored->header->fstOffset - stored->header->postingsOffset;
+    return end - stored->terms[term].postingOffset;
+}
+
+/* The last row of an encoded posting list: the sum of its row gaps. */
+static unsigned int lastEncodedRow(const unsigned char *in, unsigned int count)
+{
+    unsigned int row = 0, gap;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        in = getVarint(in, &gap);
+        row += gap;
+        while (*in++ & 0x80)
+            ;
+    }
+    return row;
+}
+
+static const char *mergeKey(SegmentMerge *merge, int s)
+{
+    StoredIndex *stored = &merge->segments[s];
+    return stored->keys + stored->terms[merge->positions[s]].keyOffset;
+}
+
+/* Segments come in row order, so for equal keys the earlier one goes
+ * first. */
+static int segmentBefore(SegmentMerge *merge, int a, int b)
+{
+    int order = strcmp(mergeKey(merge, a), mergeKey(merge, b));
+    return order != 0 ? order < 0 : a < b;
+}
+
+static void siftSegmentDown(SegmentMerge *merge, int size, int i)
+{
+    int *heap = merge->heap;
+    while (1)
+    {
+        int first = i;
+        int left = 2 * i + 1, right = left + 1;
+        if (left < size && segmentBefore(merge, heap[left], heap[first]))
+            first = left;
+        if (right < size && segmentBefore(merge, heap[right], heap[first]))
+            first = right;
+        if (first == i)
+            return;
+        int t = heap[i];
+        heap[i] = heap[first];
+        heap[first] = t;
+        i = first;
+    }
+}
+
+static void pushSegment(SegmentMerge *merge, int *size, int s)
+{
+    int *heap = merge->heap;
+    int i = (*size)++;
+    heap[i] = s;
+    while (i > 0 && segmentBefore(merge, heap[i], heap[(i - 1) / 2]))
+    {
+        int parent = (i - 1) / 2;
+        int t = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = t;
+        i = parent;
+    }
+}
+
+/* The postings of one merged term: the encoded lists of the group,
+ * chained as mergeRuns in spimi.c chains those of runs, with only the
+ * first row gap of each list rewritten. Written to merge->out, or only
+ * measured if write is 0. */
+static unsigned long long mergePostingLists(SegmentMerge *merge, int groupSize, int write)
+{
+    unsigned long long size = 0;
+    unsigned int lastRow = 0;
+    for (int g = 0; g < groupSize; g++)
+    {
+        int s = merge->group[g];
+        StoredIndex *stored = &merge->segments[s];
+        TermEntry *entry = &stored->terms[merge->positions[s]];
+        const unsigned char *in = stored->postings + entry->postingOffset;
+        unsigned int firstGap;
+        const unsigned char *rest = getVarint(in, &firstGap);
+        unsigned int firstRow = merge->rowBases[s] + firstGap;
+        unsigned long long encoded = encodedTermSize(stored, merge->positions[s]);
+        size += encoded - (rest - in) + varintSize(firstRow - lastRow);
+        if (write)
+        {
+            writeVarint(merge->out, firstRow - lastRow);
+            writeBytes(merge->out, rest, encoded - (rest - in));
+        }
+        lastRow = merge->rowBases[s] + lastEncodedRow(in, entry->postingCount);
+    }
+    return size;
+}
+
+/* One pass of the k-way merge over the term tables, doing for each
+ * merged term what pass calls for. */
+static void mergeTerms(SegmentMerge *merge, int pass)
+{
+    int size = 0;
+    for (int s = 0; s < merge->count; s++)
+    {
+        merge->positions[s] = 0;
+        if (merge->segments[s].header->wordCount > 0)
+            pushSegment(merge, &size, s);
+    }
+    merge->wordCount = 0;
+    merge->keyOffset = 0;
+    merge->postingOffset = 0;
+
+    while (size > 0)
+    {
+        int groupSize = 0;
+        do
+        {
+            merge->group[groupSize++] = merge->heap[0];
+            merge->heap[0] = merge->heap[--size];
+            siftSegmentDown(merge, size, 0);
+        } while (size > 0 && strcmp(mergeKey(merge, merge->heap[0]), mergeKey(merge, merge->group[0])) == 0);
+
+        int last = merge->group[groupSize - 1];
+        TermEntry *lastEntry = &merge->segments[last].terms[merge->positions[last]];
+        const char *key = mergeKey(merge, merge->group[0]);
+        if (pass == MERGE_COUNT)
+        {
+            if (merge->wordCount == merge->termCapacity)
+            {
+                merge->termCapacity = merge->termCapacity == 0 ? 1024 : merge->termCapacity * 2;
+                merge->termSizes = realloc(merge->termSizes, merge->termCapacity * sizeof(unsigned long long));
+            }
+            merge->termSizes[merge->wordCount] = mergePostingLists(merge, groupSize, 0);
+            fstAdd(merge->fst, key, lastEntry->keyLength);
+        }
+        else if (pass == MERGE_TERMS)
+        {
+            TermEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.keyOffset = merge->keyOffset;
+            entry.keyLength = lastEntry->keyLength;
+            entry.type = lastEntry->type;
+            entry.postingCount = 0;
+            for (int g = 0; g < groupSize; g++)
+                entry.postingCount += merge->segments[merge->group[g]].terms[merge->positions[merge->group[g]]].postingCount;
+            entry.postingOffset = merge->postingOffset;
+            writeBytes(merge->out, &entry, sizeof(entry));
+        }
+        else if (pass == MERGE_KEYS)
+            writeBytes(merge->out, key, lastEntry->keyLength + 1);
+        else
+            mergePostingLists(merge, groupSize, 1);
+        merge->keyOffset += lastEntry->keyLength + 1;
+        merge->postingOffset += merge->termSizes[merge->wordCount];
+        merge->wordCount++;
+
+        for (int g = 0; g < groupSize; g++)
+        {
+            int s = merge->group[g];
+            if (++merge->positions[s] < merge->segments[s].header->wordCount)
+                pushSegment(merge, &size, s);
+        }
+    }
+}
+
+/* Merges the segment files in paths, which hold consecutive rows in that
+ * order, into one index file at outPath, as if their documents had been
+ * indexed together. Keys are merged from the sorted term tables and
+ * posting lists are copied with one varint changed, so apart from the
+ * pass that fills in the ranking statistics nothing is decoded and the
+ * cost is a sequential read and write of the inputs. */
+int mergeSegmentFiles(char **paths, int count, char *outPath)
+{
+    SegmentMerge merge;
+    memset(&merge, 0, sizeof(merge));
+    merge.count = count;
+    merge.segments = malloc((count + 1) * sizeof(StoredIndex));
+    merge.rowBases = malloc((count + 1) * sizeof(unsigned int));
+    if (openSegments(paths, count, merge.segments, merge.rowBases) == IO_ERROR)
+    {
+        free(merge.segments);
+        free(merge.rowBases);
+        return IO_ERROR;
+    }
+    merge.positions = malloc((count + 1) * sizeof(unsigned int));
+    merge.heap = malloc((count + 1) * sizeof(int));
+    merge.group = malloc((count + 1) * sizeof(int));
+
+    Index documents;
+    initIndex(&documents);
+    for (int s = 0; s < count; s++)
+    {
+        StoredIndex *stored = &merge.segments[s];
+        for (unsigned int d = 0; d < stored->header->docCount; d++)
+        {
+            documents.rowCount = merge.rowBases[s] + stored->docFirstRows[d] - 1;
+            addDocument(&documents, stored->names + stored->docNameOffsets[d], stored->docBytes[d],
+                        stored->docCompleteBytes[d]);
+        }
+        documents.rowCount = merge.rowBases[s] + stored->header->rowCount;
+    }
+
+    int status = IO_ERROR;
+    char *tempPath;
+    FILE *fp = createIndexFile(outPath, &tempPath);
+    if (fp != NULL)
+    {
+        FstBuilder builder;
+        Fst fst;
+        initFstBuilder(&builder);
+        merge.fst = &builder;
+        mergeTerms(&merge, MERGE_COUNT);
+        finishFst(&builder, &fst);
+
+        IndexHeader header;
+        makeIndexHeader(&header, merge.wordCount, &documents, merge.keyOffset, merge.postingOffset, &fst);
+        merge.out = malloc(sizeof(OutputWriter));
+        initOutput(merge.out, fp);
+        writeBytes(merge.out, &header, sizeof(header));
+        mergeTerms(&merge, MERGE_TERMS);
+        flushOutput(merge.out);
+        writeDocumentTables(fp, &documents);
+        mergeTerms(&merge, MERGE_KEYS);
+        flushOutput(merge.out);
+        writeDocumentNames(fp, &documents);
+        mergeTerms(&merge, MERGE_POSTINGS);
+        flushOutput(merge.out);
+        fwrite(fst.bytes, 1, fst.size, fp);
+        freeFstBuilder(&builder);
+        free(merge.out);
+        status = finishIndexFile(fp, outPath, tempPath, 1);
+    }
+
+    freeIndex(&documents);
+    closeSegments(merge.segments, count);
+    free(merge.segments);
+    free(merge.rowBases);
+    free(merge.positions);
+    free(merge.heap);
+    free(merge.group);
+    free(merge.termSizes);
+    return status;
+}
+
+/* Makes one merge the policy asks for in the index in dir and sets
+ * *merged, or leaves it 0 if there is nothing to merge or another
+ * process is merging. The merge runs without the manifest lock, so
+ * appends go on meanwhile; since only merges remove segments, the ones
+ * it merged are still listed when it swaps in the result. Readers keep
+ * the files they have open: removing a segment only drops its name. */
+int mergeSegmentStep(char *dir, int *merged)
+{
+    *merged = 0;
+    int mergeLock = lockFile(dir, SEGMENT_MERGE_LOCK, LOCK_EX | LOCK_NB);
+    if (mergeLock < 0)
+        return IO_SUCCESS;
+    int lock = lockFile(dir, SEGMENT_LOCK, LOCK_EX);
+    Manifest manifest;
+    if (lock < 0 || readManifest(dir, &manifest) == IO_ERROR)
+    {
+        if (lock >= 0)
+            close(lock);
+        close(mergeLock);
+        return IO_ERROR;
+    }
+    close(lock);
+
+    int first = 0;
+    int count = pickMerge(&manifest, &first);
+    if (count == 0)
+    {
+        freeManifest(&manifest);
+        close(mergeLock);
+        return IO_SUCCESS;
+    }
+    SegmentInfo *inputs = malloc(count * sizeof(SegmentInfo));
+    memcpy(inputs, manifest.segments + first, count * sizeof(SegmentInfo));
+    freeManifest(&manifest);
+
+    SegmentInfo result;
+    memset(&result, 0, sizeof(result));
+    result.first = inputs[0].first;
+    result.last = inputs[count - 1].last;
+    snprintf(result.name, sizeof(result.name), "%08u-%08u.seg", result.first, result.last);
+    char *outPath = segmentPath(dir, result.name);
+    char **paths = malloc(count * sizeof(char *));
+    for (int s = 0; s < count; s++)
+        paths[s] = segmentPath(dir, inputs[s].name);
+    int status = mergeSegmentFiles(paths, count, outPath);
+
+    struct stat file;
+    if (status == IO_SUCCESS && stat(outPath, &file) == 0)
+        result.size = file.st_size;
+    else
+        status = IO_ERROR;
+
+    lock = status == IO_SUCCESS ? lockFile(dir, SEGMENT_LOCK, LOCK_EX) : -1;
+    if (lock < 0 || readManifest(dir, &manifest) == IO_ERROR)
+        status = IO_ERROR;
+    else
+    {
+        int at = 0;
+        while (at < manifest.count && strcmp(manifest.segments[at].name, inputs[0].name) != 0)
+            at++;
+        for (int s = 0; s < count && status == IO_SUCCESS; s++)
+            if (at + s >= manifest.count || strcmp(manifest.segments[at + s].name, inputs[s].name) != 0)
+                status = IO_ERROR;
+        if (status == IO_SUCCESS)
+        {
+            manifest.segments[at] = result;
+            memmove(manifest.segments + at + 1, manifest.segments + at + count,
+                    (manifest.count - at - count) * sizeof(SegmentInfo));
+            manifest.count -= count - 1;
+            manifest.written += result.size;
+            status = writeManifest(dir, &manifest);
+        }
+        freeManifest(&manifest);
+    }
+    if (lock >= 0)
+        close(lock);
+
+    for (int s = 0; s < count; s++)
+    {
+        if (status == IO_SUCCESS)
+            remove(paths[s]);
+        free(paths[s]);
+    }
+    if (status == IO_ERROR)
+        remove(outPath);
+    else
+        *merged = 1;
+    free(paths);
+    free(outPath);
+    free(inputs);
+    close(mergeLock);
+    return status;
+}
+
+/* Merges the index in dir until the policy is satisfied. */
+int compactSegments(char *dir)
+{
+    int merged = 1;
+    int status = IO_SUCCESS;
+    while (merged && status == IO_SUCCESS)
+        status = mergeSegmentStep(dir, &merged);
+    return status;
+}
@@ -0,0 +1,81 @@
+#ifndef __SEGMENT_H__
+#define __SEGMENT_H__
+
+#include "store.h"
+
+#define SEGMENT_MAGIC "KPLSEGS1"
+#define SEGMENT_MANIFEST "segments"
+#define SEGMENT_LOCK "lock"
+#define SEGMENT_MERGE_LOCK "merge.lock"
+
+/* Segments are merged SEGMENT_MERGE_FACTOR at a time. A segment is in
+ * tier 0 below SEGMENT_TIER_BYTES and one tier up for every further
+ * factor of SEGMENT_MERGE_FACTOR in size. */
+#define SEGMENT_MERGE_FACTOR 4
+#define SEGMENT_TIER_BYTES (1 << 20)
+
+/* Budget for the builder that writes an appended segment when none is
+ * given. */
+#define SEGMENT_APPEND_BUDGET (64L << 20)
+
+/* How often a server looks for segments to merge. */
+#define SEGMENT_MERGE_POLL_MS 1000
+
+/* A segment file as the manifest lists it. Its name gives the range of
+ * appends it holds, so a merge never reuses the name of a live file. */
+struct SegmentInfo_
+{
+    char name[32];
+    unsigned int first;
+    unsigned int last;
+    unsigned long long size;
+};
+
+typedef struct SegmentInfo_ SegmentInfo;
+
+/* The list of segments of an index directory, oldest rows first, and
+ * what it took to write them: ingested counts the bytes of appended
+ * segments, written those of every segment file ever written, merges
+ * included, so written / ingested is the write amplification. */
+struct Manifest_
+{
+    unsigned int next;
+    unsigned long long ingested;
+    unsigned long long written;
+    SegmentInfo *segments;
+    int count;
+};
+
+typedef struct Manifest_ Manifest;
+
+/* The segments of an index opened together for queries. Each is an
+ * index file with rows and documents numbered from its own start; the
+ * bases turn them into those of the whole index. docFirstRows is the
+ * table for the whole index. A plain index file opens as one segment. */
+struct SegmentSet_
+{
+    StoredIndex *segments;
+    unsigned int *rowBases;
+    int count;
+    unsigned int *docFirstRows;
+    int docCount;
+    unsigned int rowCount;
+};
+
+typedef struct SegmentSet_ SegmentSet;
+
+int isSegmentDirectory(char *path);
+char *watchedPath(char *path);
+int openSegmentSet(char *path, SegmentSet *set);
+void closeSegmentSet(SegmentSet *set);
+
+int readManifest(char *dir, Manifest *manifest);
+void freeManifest(Manifest *manifest);
+int pickMerge(Manifest *manifest, int *first);
+
+int appendSegment(char *dir, char **paths, int pathCount, Dict *stopWords, int threads, long budget);
+int mergeSegmentFiles(char **paths, int count, char *outPath);
+int mergeSegmentStep(char *dir, int *merged);
+int compactSegments(char *dir);
+
+#endif
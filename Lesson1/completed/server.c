@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "table.h"
+
+static char *servedPath;
+static char *watched;
+static Dict *servedStopWords;
+static Snapshot *current;
+static QueryReader *readers;
+static int readerCount;
+
+/* Connections with input waiting for a worker. */
+static Connection *clients[SERVER_QUEUE_SIZE];
+static int clientHead, clientCount;
+static pthread_mutex_t clientLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clientWaiting = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t clientRoom = PTHREAD_COND_INITIALIZER;
+
+/* Connections the workers are done with, for the accepting thread to
+ * poll again; a byte on wakePipe tells it there are some. */
+static Connection **returned;
+static int returnedCount, returnedCapacity;
+static pthread_mutex_t returnedLock = PTHREAD_MUTEX_INITIALIZER;
+static int wakePipe[2];
+
+/* Connections waiting for input, polled by the accepting thread only. */
+static Connection **idle;
+static int idleCount, idleCapacity;
+
+static Snapshot *openSnapshot()
+{
+    Snapshot *snapshot = malloc(sizeof(Snapshot));
+    if (stat(watched, &snapshot->status) != 0 || openSegmentSet(servedPath, &snapshot->set) == IO_ERROR)
+    {
+        free(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
+
+static int sameFile(struct stat *a, struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static Snapshot *enterSnapshot(QueryReader *reader)
+{
+    __atomic_add_fetch(&reader->sequence, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+}
+
+static void leaveSnapshot(QueryReader *reader)
+{
+    __atomic_add_fetch(&reader->sequence, 1, __ATOMIC_RELEASE);
+}
+
+/* Waits until every reader that was using a snapshot when this was
+ * called has left it. Those that enter afterwards see the new one. */
+static void waitForReaders()
+{
+    struct timespec pause = {0, 1000000};
+    for (int r = 0; r < readerCount; r++)
+    {
+        unsigned long sequence = __atomic_load_n(&readers[r].sequence, __ATOMIC_SEQ_CST);
+        if (!(sequence & 1))
+            continue;
+        while (__atomic_load_n(&readers[r].sequence, __ATOMIC_ACQUIRE) == sequence)
+            nanosleep(&pause, NULL);
+    }
+}
+
+/* Polls the index file, or the manifest of a segment directory, and when
+ * a new one has been renamed into place publishes it with one pointer
+ * swap and unmaps the old one after its last reader is done. Every file
+ * is opened, and so checked through by openIndexFile, before the swap:
+ * one that is not a whole index, be it only a damaged term entry, is
+ * left alone until it changes again and queries stay on the old one. */
+static void *reloadIndex(void *arg)
+{
+    struct timespec pause = {SERVER_POLL_MS / 1000, SERVER_POLL_MS % 1000 * 1000000L};
+    struct stat rejected;
+    memset(&rejected, 0, sizeof(rejected));
+    while (1)
+    {
+        nanosleep(&pause, NULL);
+        struct stat status;
+        if (stat(watched, &status) != 0 || sameFile(&status, &current->status) || sameFile(&status, &rejected))
+            continue;
+        Snapshot *fresh = openSnapshot();
+        if (fresh == NULL)
+        {
+            rejected = status;
+            continue;
+        }
+        Snapshot *old = __atomic_exchange_n(&current, fresh, __ATOMIC_SEQ_CST);
+        waitForReaders();
+        closeSegmentSet(&old->set);
+        free(old);
+        fprintf(stderr, "Reloaded index %s\n", servedPath);
+    }
+    return NULL;
+}
+
+/* Keeps the segments of a served directory merged as the policy asks,
+ * in the background. A merge publishes a new manifest, which the
+ * reloader then picks up like any other change, so queries go on against
+ * the old segments while it runs. */
+static void *mergeSegments(void *arg)
+{
+    struct timespec pause = {SEGMENT_MERGE_POLL_MS / 1000, SEGMENT_MERGE_POLL_MS % 1000 * 1000000L};
+    while (1)
+    {
+        nanosleep(&pause, NULL);
+        int merged = 1;
+        while (merged)
+        {
+            if (mergeSegmentStep(servedPath, &merged) == IO_ERROR)
+            {
+                fprintf(stderr, "Cannot merge segments of %s\n", servedPath);
+                break;
+            }
+            if (merged)
+                fprintf(stderr, "Merged segments of %s\n", servedPath);
+        }
+    }
+    return NULL;
+}
+
+/* Answers the query on line, length bytes ending in any newline, with
+ * one line through writer. The snapshot is held for this query only, so
+ * a long connection does not hold back a reload. */
+static void answerLine(char *line, int length, QueryReader *reader, OutputWriter *writer)
+{
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+        length--;
+    line[length] = '\0';
+    Snapshot *snapshot = enterSnapshot(reader);
+    printQuery(writer, &snapshot->set, servedStopWords, line);
+    leaveSnapshot(reader);
+}
+
+/* Answers the queries read from in, one per line, each with one line on
+ * out, until in ends. */
+static void serveQueries(FILE *in, FILE *out, QueryReader *reader, OutputWriter *writer)
+{
+    initOutput(writer, out);
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, in)) != -1)
+    {
+        answerLine(line, length, reader, writer);
+        flushOutput(writer);
+    }
+    free(line);
+}
+
+static void pushClient(Connection *client)
+{
+    pthread_mutex_lock(&clientLock);
+    while (clientCount == SERVER_QUEUE_SIZE)
+        pthread_cond_wait(&clientRoom, &clientLock);
+    clients[(clientHead + clientCount++) % SERVER_QUEUE_SIZE] = client;
+    pthread_cond_signal(&clientWaiting);
+    pthread_mutex_unlock(&clientLock);
+}
+
+static Connection *popClient()
+{
+    pthread_mutex_lock(&clientLock);
+    while (clientCount == 0)
+        pthread_cond_wait(&clientWaiting, &clientLock);
+    Connection *client = clients[clientHead];
+    clientHead = (clientHead + 1) % SERVER_QUEUE_SIZE;
+    clientCount--;
+    pthread_cond_signal(&clientRoom);
+    pthread_mutex_unlock(&clientLock);
+    return client;
+}
+
+static Connection *openConnection(int fd)
+{
+    int copy = dup(fd);
+    FILE *out = copy < 0 ? NULL : fdopen(copy, "w");
+    if (out == NULL)
+    {
+        if (copy >= 0)
+            close(copy);
+        close(fd);
+        return NULL;
+    }
+    Connection *connection = malloc(sizeof(Connection));
+    connection->fd = fd;
+    connection->out = out;
+    connection->input = NULL;
+    connection->length = 0;
+    connection->capacity = 0;
+    return connection;
+}
+
+static void closeConnection(Connection *connection)
+{
+    fclose(connection->out);
+    close(connection->fd);
+    free(connection->input);
+    free(connection);
+}
+
+/* Reads what the client has sent, which poll said there is, and answers
+ * each whole line of it, as serveQueries would; a line cut short waits
+ * for the rest. At the end of the input a last line without a newline
+ * is answered too. Returns 0 once the connection is done with. */
+static int answerRequest(Connection *connection, QueryReader *reader, OutputWriter *writer)
+{
+    if (connection->capacity - connection->length < SERVER_READ_SIZE + 1)
+    {
+        connection->capacity = connection->length + SERVER_READ_SIZE + 1;
+        connection->input = realloc(connection->input, connection->capacity);
+    }
+    ssize_t n = read(connection->fd, connection->input + connection->length, SERVER_READ_SIZE);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 1;
+    initOutput(writer, connection->out);
+    int start = 0;
+    if (n > 0)
+    {
+        connection->length += n;
+        for (int i = connection->length - n; i < connection->length; i++)
+            if (connection->input[i] == '\n')
+            {
+                answerLine(connection->input + start, i + 1 - start, reader, writer);
+                start = i + 1;
+            }
+    }
+    else if (connection->length > 0)
+    {
+        answerLine(connection->input, connection->length, reader, writer);
+        start = connection->length;
+    }
+    flushOutput(writer);
+    connection->length -= start;
+    memmove(connection->input, connection->input + start, connection->length);
+    return n > 0 && !ferror(connection->out);
+}
+
+static void returnConnection(Connection *connection)
+{
+    pthread_mutex_lock(&returnedLock);
+    if (returnedCount == returnedCapacity)
+    {
+        returnedCapacity = returnedCapacity == 0 ? 16 : returnedCapacity * 2;
+        returned = realloc(returned, returnedCapacity * sizeof(Connection *));
+    }
+    returned[returnedCount++] = connection;
+    pthread_mutex_unlock(&returnedLock);
+    /* the pipe is non-blocking: if it is full a wake-up is pending */
+    if (write(wakePipe[1], "", 1) < 0)
+        return;
+}
+
+/* Takes one request at a time from any connection, so that -j workers
+ * serve any number of clients and one that says nothing holds none. */
+static void *runWorker(void *arg)
+{
+    QueryReader *reader = arg;
+    OutputWriter *writer = malloc(sizeof(OutputWriter));
+    while (1)
+    {
+        Connection *connection = popClient();
+        if (answerRequest(connection, reader, writer))
+            returnConnection(connection);
+        else
+            closeConnection(connection);
+    }
+    return NULL;
+}
+
+static void keepIdle(Connection *connection)
+{
+    if (idleCount == idleCapacity)
+    {
+        idleCapacity = idleCapacity == 0 ? 16 : idleCapacity * 2;
+        idle = realloc(idle, idleCapacity * sizeof(Connection *));
+    }
+    idle[idleCount++] = connection;
+}
+
+/* Accepts connections and polls the idle ones, handing each that has
+ * input to the workers and taking it back when they are done. */
+static void dispatchClients(int listener)
+{
+    struct pollfd *polled = NULL;
+    int polledCapacity = 0;
+    while (1)
+    {
+        if (polledCapacity < idleCount + 2)
+        {
+            polledCapacity = (idleCount + 2) * 2;
+            polled = realloc(polled, polledCapacity * sizeof(struct pollfd));
+        }
+        polled[0].fd = wakePipe[0];
+        polled[1].fd = listener;
+        for (int i = 0; i < idleCount; i++)
+            polled[i + 2].fd = idle[i]->fd;
+        for (int i = 0; i < idleCount + 2; i++)
+        {
+            polled[i].events = POLLIN;
+            polled[i].revents = 0;
+        }
+        if (poll(polled, idleCount + 2, -1) < 0)
+            continue;
+
+        int kept = 0;
+        for (int i = 0; i < idleCount; i++)
+        {
+            if (polled[i + 2].revents != 0)
+                pushClient(idle[i]);
+            else
+                idle[kept++] = idle[i];
+        }
+        idleCount = kept;
+        if (polled[0].revents & POLLIN)
+        {
+            char drained[256];
+            while (read(wakePipe[0], drained, sizeof(drained)) > 0)
+                ;
+            pthread_mutex_lock(&returnedLock);
+            for (int i = 0; i < returnedCount; i++)
+                keepIdle(returned[i]);
+            returnedCount = 0;
+            pthread_mutex_unlock(&returnedLock);
+        }
+        if (polled[1].revents & POLLIN)
+        {
+            int client = accept(listener, NULL, NULL);
+            Connection *connection = client < 0 ? NULL : openConnection(client);
+            if (connection != NULL)
+                keepIdle(connection);
+        }
+    }
+}
+
+/* Serves queries on the index file or segment directory at indexPath,
+ * as -q answers them, from threads workers that take the requests sent
+ * on connections to the Unix socket at socketPath, one at a time, or
+ * from stdin to stdout if socketPath is "-". The index is mapped once
+ * and shared; when a rebuilt file or a new list of segments replaces it
+ * the server moves to the new one without stopping. The segments of a
+ * directory are merged by a thread of their own. Returns IO_ERROR if the
+ * index cannot be opened or the socket cannot be set up; otherwise it
+ * only returns when stdin ends. */
+int serveIndex(char *indexPath, char *socketPath, Dict *stopWords, int threads)
+{
+    servedPath = indexPath;
+    watched = watchedPath(indexPath);
+    servedStopWords = stopWords;
+    current = openSnapshot();
+    if (current == NULL)
+        return IO_ERROR;
+    if (threads < 1)
+        threads = 1;
+    readerCount = threads + 1;
+    readers = calloc(readerCount, sizeof(QueryReader));
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t reloader;
+    pthread_create(&reloader, NULL, reloadIndex, NULL);
+    if (isSegmentDirectory(indexPath))
+    {
+        pthread_t merger;
+        pthread_create(&merger, NULL, mergeSegments, NULL);
+    }
+    if (strcmp(socketPath, "-") == 0)
+    {
+        OutputWriter *writer = malloc(sizeof(OutputWriter));
+        serveQueries(stdin, stdout, &readers[threads], writer);
+        free(writer);
+        return IO_SUCCESS;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+        return IO_ERROR;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SERVER_BACKLOG) != 0)
+        return IO_ERROR;
+
+    if (pipe(wakePipe) != 0)
+        return IO_ERROR;
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_t worker;
+        pthread_create(&worker, NULL, runWorker, &readers[t]);
+    }
+    dispatchClients(listener);
+    return IO_SUCCESS;
+}
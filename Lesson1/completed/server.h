@@ -0,0 +1,55 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "segment.h"
+
+#define SERVER_POLL_MS 200
+#define SERVER_BACKLOG 64
+#define SERVER_QUEUE_SIZE 256
+#define SERVER_READ_SIZE 4096
+
+/* One generation of the served index: its segments as they were mapped,
+ * and the stat of the index file or manifest they were found from, to
+ * notice when it is replaced. */
+struct Snapshot_
+{
+    SegmentSet set;
+    struct stat status;
+};
+
+typedef struct Snapshot_ Snapshot;
+
+/* A thread that answers queries. Its sequence is odd while it is using a
+ * snapshot, so the thread that swaps in a new snapshot can tell when no
+ * reader holds the old one any more and unmap it (quiescent state based
+ * reclamation, a form of RCU). Readers never wait for the swap. Each
+ * reader has a cache line of its own. */
+struct QueryReader_
+{
+    unsigned long sequence;
+    char padding[64 - sizeof(unsigned long)];
+};
+
+typedef struct QueryReader_ QueryReader;
+
+/* A client connection. Between requests it waits in the poll set of the
+ * accepting thread; when it has input it is handed to a worker, which
+ * answers the whole lines read so far and gives it back, so an idle
+ * client holds no worker. */
+struct Connection_
+{
+    int fd;
+    FILE *out;
+    char *input; /* the start of a line not yet answered */
+    int length;
+    int capacity;
+};
+
+typedef struct Connection_ Connection;
+
+int serveIndex(char *indexPath, char *socketPath, Dict *stopWords, int threads);
+
+#endif
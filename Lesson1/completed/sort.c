@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort.h"
+
+#define INSERTION_CUTOFF 32
+
+static void insertionSort(int *ids, int n, char **keys, int depth)
+{
+    for (int i = 1; i < n; i++)
+    {
+        int id = ids[i];
+        const char *key = keys[id] + depth;
+        int j = i - 1;
+        while (j >= 0 && strcmp(keys[ids[j]] + depth, key) > 0)
+        {
+            ids[j + 1] = ids[j];
+            j--;
+        }
+        ids[j + 1] = id;
+    }
+}
+
+/* MSD radix sort: distribute on the byte at depth, then recurse into each
+ * bucket on the next byte. Keys are distinct and NUL terminated, so the
+ * bucket for byte 0 never holds more than one id. */
+static void msdSort(int *ids, int *buffer, int n, char **keys, int depth)
+{
+    if (n < INSERTION_CUTOFF)
+    {
+        insertionSort(ids, n, keys, depth);
+        return;
+    }
+
+    int count[257];
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < n; i++)
+        count[(unsigned char)keys[ids[i]][depth] + 1]++;
+    for (int c = 1; c < 257; c++)
+        count[c] += count[c - 1];
+
+    int start[256];
+    memcpy(start, count, sizeof(start));
+    for (int i = 0; i < n; i++)
+        buffer[start[(unsigned char)keys[ids[i]][depth]]++] = ids[i];
+    memcpy(ids, buffer, n * sizeof(int));
+
+    for (int c = 1; c < 256; c++)
+    {
+        int size = count[c + 1] - count[c];
+        if (size > 1)
+            msdSort(ids + count[c], buffer + count[c], size, keys, depth + 1);
+    }
+}
+
+void sortWordIds(int *ids, int n, char **keys)
+{
+    int *buffer = malloc(n * sizeof(int));
+    msdSort(ids, buffer, n, keys, 0);
+    free(buffer);
+}
@@ -0,0 +1,8 @@
+#ifndef __SORT_H__
+#define __SORT_H__
+
+/* Sorts the word ids in ids[0..n) so that keys[ids[i]] are in strcmp order.
+ * Only the ids move; the keys and anything else indexed by id stay put. */
+void sortWordIds(int *ids, int n, char **keys);
+
+#endif
@@ -0,0 +1,570 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "spimi.h"
+#include "store.h"
+#include "sort.h"
+#include "input.h"
+#include "output.h"
+
+/* One term of a run file, followed by its key with the NUL and then
+ * encodedSize bytes of postings in encodePostings form. */
+struct RunTerm_
+{
+    int keyLength;
+    int type;
+    unsigned int postingCount;
+    unsigned int lastRow;
+    unsigned long long encodedSize;
+};
+
+typedef struct RunTerm_ RunTerm;
+
+/* A run file being read back, positioned after the key of term. */
+struct RunReader_
+{
+    FILE *file;
+    RunTerm term;
+    char *key;
+    int keyCapacity;
+    int done;
+};
+
+typedef struct RunReader_ RunReader;
+
+/* Where a merge writes its terms: the term table, keys, postings and
+ * automaton of an index file, or all to one writer for a merge into a
+ * run, which has no automaton. */
+struct MergeOutput_
+{
+    OutputWriter *terms;
+    OutputWriter *keys;
+    OutputWriter *postings;
+    FstBuilder *fst;
+    int toRun;
+    unsigned int wordCount;
+    unsigned int keyOffset;
+    unsigned long long postingOffset;
+};
+
+typedef struct MergeOutput_ MergeOutput;
+
+static char *runPath(char *indexPath, int number)
+{
+    char *path = malloc(strlen(indexPath) + 16);
+    sprintf(path, "%s.run%d", indexPath, number);
+    return path;
+}
+
+static char *tempPath(char *indexPath, const char *suffix)
+{
+    char *path = malloc(strlen(indexPath) + strlen(suffix) + 2);
+    sprintf(path, "%s.%s", indexPath, suffix);
+    return path;
+}
+
+static void removeRuns(char **paths, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        remove(paths[i]);
+        free(paths[i]);
+    }
+}
+
+static int closeWritten(FILE *fp)
+{
+    int ok = !ferror(fp);
+    if (fclose(fp) != 0)
+        ok = 0;
+    return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+/* Bytes allocated for block: hash slots, key arena, per word arrays and
+ * the capacity of every posting list. */
+static long blockBytes(Index *block)
+{
+    long bytes = (long)block->dict.capacity * sizeof(DictSlot) +
+                 (long)block->dict.keyCapacity * (sizeof(char *) + sizeof(int)) +
+                 (long)block->capacity * (sizeof(int) + sizeof(PostingList));
+    for (ArenaBlock *arena = block->dict.arena; arena != NULL; arena = arena->next)
+        bytes += sizeof(ArenaBlock) + arena->size;
+    for (int i = 0; i < block->dict.count; i++)
+        bytes += (long)block->postings[i].capacity * sizeof(Posting);
+    return bytes;
+}
+
+/* Drops the pages of a mapped input between start and end, which the
+ * block no longer needs since its keys are copies, so a large file does
+ * not stay resident once it has been read. */
+static void releasePages(InputBuffer *input, long start, long end)
+{
+    if (!input->mapped)
+        return;
+    long page = sysconf(_SC_PAGESIZE);
+    start = start / page * page;
+    end = end / page * page;
+    if (end > start)
+        madvise(input->data + start, end - start, MADV_DONTNEED);
+}
+
+/* Writes the terms of block to a run file in key order. */
+static int writeRun(Index *block, char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return IO_ERROR;
+
+    int wordCount = block->dict.count;
+    int *order = malloc((wordCount + 1) * sizeof(int));
+    for (int i = 0; i < wordCount; i++)
+        order[i] = i;
+    sortWordIds(order, wordCount, block->dict.keys);
+
+    OutputWriter *out = malloc(sizeof(OutputWriter));
+    initOutput(out, fp);
+    unsigned char *encoded = NULL;
+    long encodedCapacity = 0;
+    for (int k = 0; k < wordCount; k++)
+    {
+        int i = order[k];
+        PostingList *list = &block->postings[i];
+        RunTerm term;
+        term.keyLength = block->dict.lengths[i];
+        term.type = block->types[i];
+        term.postingCount = list->length;
+        term.lastRow = postingRow(list->items[list->length - 1]);
+        term.encodedSize = encodedPostingsSize(list->items, list->length);
+        writeBytes(out, &term, sizeof(term));
+        writeBytes(out, block->dict.keys[i], term.keyLength + 1);
+        if (term.encodedSize > encodedCapacity)
+        {
+            encodedCapacity = term.encodedSize * 2;
+            encoded = realloc(encoded, encodedCapacity);
+        }
+        writeBytes(out, encoded, encodePostings(list->items, list->length, encoded));
+    }
+    flushOutput(out);
+    free(encoded);
+    free(out);
+    free(order);
+    return closeWritten(fp);
+}
+
+/* Writes block out as the next run and empties it, keeping its row
+ * count so the following rows are numbered after it. */
+static int flushBlock(Index *block, char *indexPath, char ***runs, int *runCount, int *runNumber)
+{
+    char *path = runPath(indexPath, (*runNumber)++);
+    int status = writeRun(block, path);
+    if (status == IO_ERROR)
+    {
+        remove(path);
+        free(path);
+    }
+    else
+    {
+        *runs = realloc(*runs, (*runCount + 1) * sizeof(char *));
+        (*runs)[(*runCount)++] = path;
+    }
+    int rowCount = block->rowCount;
+    freeIndex(block);
+    initIndex(block);
+    block->rowCount = rowCount;
+    return status;
+}
+
+/* Reads the header and key of the next term of run, or sets done. */
+static void advanceRun(RunReader *run)
+{
+    if (fread(&run->term, sizeof(RunTerm), 1, run->file) != 1)
+    {
+        run->done = 1;
+        return;
+    }
+    if (run->term.keyLength + 1 > run->keyCapacity)
+    {
+        run->keyCapacity = run->term.keyLength + 1;
+        run->key = realloc(run->key, run->keyCapacity);
+    }
+    if (fread(run->key, run->term.keyLength + 1, 1, run->file) != 1)
+        run->done = 1;
+}
+
+/* Returns IO_ERROR if a run could not be read through. */
+static int closeRuns(RunReader *runs, int count)
+{
+    int status = IO_SUCCESS;
+    for (int i = 0; i < count; i++)
+    {
+        if (runs[i].file == NULL)
+            continue;
+        if (ferror(runs[i].file))
+            status = IO_ERROR;
+        fclose(runs[i].file);
+        free(runs[i].key);
+    }
+    return status;
+}
+
+static int openRuns(char **paths, int count, RunReader *runs)
+{
+    memset(runs, 0, count * sizeof(RunReader));
+    for (int i = 0; i < count; i++)
+    {
+        runs[i].file = fopen(paths[i], "rb");
+        if (runs[i].file == NULL)
+        {
+            closeRuns(runs, i);
+            return IO_ERROR;
+        }
+        advanceRun(&runs[i]);
+    }
+    return IO_SUCCESS;
+}
+
+static void copyBytes(FILE *from, OutputWriter *to, unsigned long long count, char *chunk)
+{
+    while (count > 0)
+    {
+        size_t size = count < INPUT_CHUNK_SIZE ? count : INPUT_CHUNK_SIZE;
+        size = fread(chunk, 1, size, from);
+        if (size == 0)
+            return;
+        writeBytes(to, chunk, size);
+        count -= size;
+    }
+}
+
+/* Runs come in row order, so for equal keys the earlier run goes first. */
+static int runBefore(RunReader *runs, int a, int b)
+{
+    int order = strcmp(runs[a].key, runs[b].key);
+    return order != 0 ? order < 0 : a < b;
+}
+
+static void siftRunDown(RunReader *runs, int *heap, int size, int i)
+{
+    while (1)
+    {
+        int first = i;
+        int left = 2 * i + 1, right = left + 1;
+        if (left < size && runBefore(runs, heap[left], heap[first]))
+            first = left;
+        if (right < size && runBefore(runs, heap[right], heap[first]))
+            first = right;
+        if (first == i)
+            return;
+        int t = heap[i];
+        heap[i] = heap[first];
+        heap[first] = t;
+        i = first;
+    }
+}
+
+static void pushRun(RunReader *runs, int *heap, int *size, int run)
+{
+    int i = (*size)++;
+    heap[i] = run;
+    while (i > 0 && runBefore(runs, heap[i], heap[(i - 1) / 2]))
+    {
+        int parent = (i - 1) / 2;
+        int t = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = t;
+        i = parent;
+    }
+}
+
+static void writeMergedTerm(MergeOutput *out, RunTerm *term, const char *key)
+{
+    if (out->toRun)
+    {
+        writeBytes(out->terms, term, sizeof(RunTerm));
+        writeBytes(out->terms, key, term->keyLength + 1);
+        return;
+    }
+    TermEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.keyOffset = out->keyOffset;
+    entry.keyLength = term->keyLength;
+    entry.type = term->type;
+    entry.postingCount = term->postingCount;
+    entry.postingOffset = out->postingOffset;
+    writeBytes(out->terms, &entry, sizeof(entry));
+    writeBytes(out->keys, key, term->keyLength + 1);
+    fstAdd(out->fst, key, term->keyLength);
+    out->wordCount++;
+    out->keyOffset += term->keyLength + 1;
+    out->postingOffset += term->encodedSize;
+}
+
+/* k-way merge of runs by key. The runs of a key hold disjoint, rising
+ * rows, so its encoded posting lists are chained as they are: only the
+ * first row gap of each list after the first changes, from its row to
+ * the distance from the previous list's last row. */
+static void mergeRuns(RunReader *runs, int count, MergeOutput *out)
+{
+    int *heap = malloc((count + 1) * sizeof(int));
+    int *group = malloc((count + 1) * sizeof(int));
+    unsigned int *firstRows = malloc((count + 1) * sizeof(unsigned int));
+    char *chunk = malloc(INPUT_CHUNK_SIZE);
+    int size = 0;
+    for (int r = 0; r < count; r++)
+        if (!runs[r].done)
+            pushRun(runs, heap, &size, r);
+
+    while (size > 0)
+    {
+        int groupSize = 0;
+        do
+        {
+            group[groupSize++] = heap[0];
+            heap[0] = heap[--size];
+            siftRunDown(runs, heap, size, 0);
+        } while (size > 0 && strcmp(runs[heap[0]].key, runs[group[0]].key) == 0);
+
+        RunTerm merged = runs[group[0]].term;
+        merged.postingCount = 0;
+        merged.encodedSize = 0;
+        unsigned int lastRow = 0;
+        for (int g = 0; g < groupSize; g++)
+        {
+            RunTerm *term = &runs[group[g]].term;
+            firstRows[g] = readFileVarint(runs[group[g]].file);
+            merged.type = term->type;
+            merged.postingCount += term->postingCount;
+            merged.encodedSize += term->encodedSize - varintSize(firstRows[g]) + varintSize(firstRows[g] - lastRow);
+            lastRow = term->lastRow;
+        }
+        merged.lastRow = lastRow;
+        writeMergedTerm(out, &merged, runs[group[0]].key);
+
+        lastRow = 0;
+        for (int g = 0; g < groupSize; g++)
+        {
+            RunReader *run = &runs[group[g]];
+            writeVarint(out->postings, firstRows[g] - lastRow);
+            copyBytes(run->file, out->postings, run->term.encodedSize - varintSize(firstRows[g]), chunk);
+            lastRow = run->term.lastRow;
+            advanceRun(run);
+            if (!run->done)
+                pushRun(runs, heap, &size, group[g]);
+        }
+    }
+    free(chunk);
+    free(firstRows);
+    free(group);
+    free(heap);
+}
+
+/* Merges the run files in paths into one run file at path. */
+static int mergeToRun(char **paths, int count, char *path)
+{
+    RunReader *runs = malloc(count * sizeof(RunReader));
+    if (openRuns(paths, count, runs) == IO_ERROR)
+    {
+        free(runs);
+        return IO_ERROR;
+    }
+    int status = IO_ERROR;
+    FILE *fp = fopen(path, "wb");
+    if (fp != NULL)
+    {
+        OutputWriter *writer = malloc(sizeof(OutputWriter));
+        initOutput(writer, fp);
+        MergeOutput out = {writer, writer, writer, NULL, 1, 0, 0, 0};
+        mergeRuns(runs, count, &out);
+        flushOutput(writer);
+        free(writer);
+        status = closeWritten(fp);
+    }
+    if (closeRuns(runs, count) == IO_ERROR)
+        status = IO_ERROR;
+    if (status == IO_ERROR)
+        remove(path);
+    free(runs);
+    return status;
+}
+
+static void copyFile(FILE *from, FILE *to, char *chunk)
+{
+    rewind(from);
+    size_t size;
+    while ((size = fread(chunk, 1, INPUT_CHUNK_SIZE, from)) > 0)
+        fwrite(chunk, 1, size, to);
+}
+
+/* Merges the run files in paths into the index file at indexPath. The
+ * term table, keys and postings are only complete once the merge is
+ * over, but the header needs their sizes and the format puts them in
+ * that order, so each goes to a temporary file first and the three are
+ * then copied into place around the document sections. The automaton,
+ * which is much smaller, is built in memory as the keys go by. */
+static int mergeToIndex(char *indexPath, char **paths, int count, Index *documents)
+{
+    RunReader *runs = malloc((count + 1) * sizeof(RunReader));
+    if (openRuns(paths, count, runs) == IO_ERROR)
+    {
+        free(runs);
+        return IO_ERROR;
+    }
+    const char *suffixes[3] = {"terms", "keys", "postings"};
+    char *sectionPaths[3];
+    FILE *sections[3];
+    OutputWriter *writers[3];
+    int status = IO_SUCCESS;
+    for (int s = 0; s < 3; s++)
+    {
+        sectionPaths[s] = tempPath(indexPath, suffixes[s]);
+        sections[s] = fopen(sectionPaths[s], "w+b");
+        writers[s] = malloc(sizeof(OutputWriter));
+        if (sections[s] == NULL)
+            status = IO_ERROR;
+        else
+            initOutput(writers[s], sections[s]);
+    }
+
+    char *filePath = NULL;
+    FILE *fp = status == IO_SUCCESS ? createIndexFile(indexPath, &filePath) : NULL;
+    if (fp == NULL)
+        status = IO_ERROR;
+    else
+    {
+        FstBuilder builder;
+        Fst fst;
+        initFstBuilder(&builder);
+        MergeOutput out = {writers[0], writers[1], writers[2], &builder, 0, 0, 0, 0};
+        mergeRuns(runs, count, &out);
+        for (int s = 0; s < 3; s++)
+            flushOutput(writers[s]);
+        finishFst(&builder, &fst);
+
+        IndexHeader header;
+        makeIndexHeader(&header, out.wordCount, documents, out.keyOffset, out.postingOffset, &fst);
+        fwrite(&header, sizeof(header), 1, fp);
+        char *chunk = malloc(INPUT_CHUNK_SIZE);
+        copyFile(sections[0], fp, chunk);
+        writeDocumentTables(fp, documents);
+        copyFile(sections[1], fp, chunk);
+        writeDocumentNames(fp, documents);
+        copyFile(sections[2], fp, chunk);
+        fwrite(fst.bytes, 1, fst.size, fp);
+        free(chunk);
+        freeFstBuilder(&builder);
+
+        int ok = 1;
+        for (int s = 0; s < 3; s++)
+            if (ferror(sections[s]))
+                ok = 0;
+        for (int r = 0; r < count; r++)
+            if (ferror(runs[r].file))
+                ok = 0;
+        status = finishIndexFile(fp, indexPath, filePath, ok);
+    }
+
+    for (int s = 0; s < 3; s++)
+    {
+        if (sections[s] != NULL)
+        {
+            fclose(sections[s]);
+            remove(sectionPaths[s]);
+        }
+        free(sectionPaths[s]);
+        free(writers[s]);
+    }
+    closeRuns(runs, count);
+    free(runs);
+    return status;
+}
+
+/* Writes the index of the documents in paths to indexPath with memory
+ * bounded by budget bytes instead of by the size of the corpus (single
+ * pass in-memory indexing, SPIMI). The documents are indexed slice by
+ * slice into a block; whenever the block has grown past the budget its
+ * terms are written out sorted, as a run, and it starts over empty.
+ * A k-way merge of the runs then produces the same file writeIndexFile
+ * would. What stays in memory besides the block is the document table,
+ * the automaton over the keys, one open file per run being merged, and
+ * the inputs that cannot be mapped (pipes, UTF-16 files), which are read
+ * whole. Run files and the merge's temporary files go next to
+ * indexPath. */
+int buildIndexFile(char *indexPath, char **paths, int pathCount, Dict *stopWords, int threads, long budget)
+{
+    long slice = budget / SPIMI_SLICES;
+    if (slice < SPIMI_MIN_SLICE)
+        slice = SPIMI_MIN_SLICE;
+
+    Index documents, block;
+    initIndex(&documents);
+    initIndex(&block);
+    char **runs = NULL;
+    int runCount = 0, runNumber = 0;
+    int status = IO_SUCCESS;
+    for (int d = 0; d < pathCount && status == IO_SUCCESS; d++)
+    {
+        InputBuffer input;
+        if (openTextInput(paths[d], &input) == IO_ERROR)
+        {
+            printf("Cannot open file %s\n", paths[d]);
+            continue;
+        }
+        documents.rowCount = block.rowCount;
+        addDocument(&documents, paths[d], input.size, completeLinesSize(input.data, input.size));
+        long start = 0;
+        while (start < input.size && status == IO_SUCCESS)
+        {
+            long end = input.size;
+            if (start + slice < input.size)
+            {
+                char *newline = memchr(input.data + start + slice, '\n', input.size - start - slice);
+                if (newline != NULL)
+                    end = newline - input.data + 1;
+            }
+            indexTextParallel(&block, stopWords, input.data + start, end - start, threads);
+            releasePages(&input, start, end);
+            start = end;
+            if (blockBytes(&block) >= budget)
+                status = flushBlock(&block, indexPath, &runs, &runCount, &runNumber);
+        }
+        closeInput(&input);
+    }
+    documents.rowCount = block.rowCount;
+    if (status == IO_SUCCESS && block.dict.count > 0)
+        status = flushBlock(&block, indexPath, &runs, &runCount, &runNumber);
+    freeIndex(&block);
+
+    while (status == IO_SUCCESS && runCount > SPIMI_FAN_IN)
+    {
+        char **merged = malloc(((runCount + SPIMI_FAN_IN - 1) / SPIMI_FAN_IN) * sizeof(char *));
+        int mergedCount = 0;
+        int first = 0;
+        while (first < runCount && status == IO_SUCCESS)
+        {
+            int count = runCount - first < SPIMI_FAN_IN ? runCount - first : SPIMI_FAN_IN;
+            char *path = runPath(indexPath, runNumber++);
+            status = mergeToRun(runs + first, count, path);
+            if (status == IO_ERROR)
+            {
+                free(path);
+                break;
+            }
+            removeRuns(runs + first, count);
+            merged[mergedCount++] = path;
+            first += count;
+        }
+        removeRuns(runs + first, runCount - first);
+        free(runs);
+        runs = merged;
+        runCount = mergedCount;
+    }
+    if (status == IO_SUCCESS)
+        status = mergeToIndex(indexPath, runs, runCount, &documents);
+    removeRuns(runs, runCount);
+    free(runs);
+    freeIndex(&documents);
+    return status;
+}
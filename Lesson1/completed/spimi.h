@@ -0,0 +1,17 @@
+#ifndef __SPIMI_H__
+#define __SPIMI_H__
+
+#include "index.h"
+
+/* A block is measured against the budget after every slice of text,
+ * and a slice is this fraction of the budget, at least SPIMI_MIN_SLICE. */
+#define SPIMI_SLICES 16
+#define SPIMI_MIN_SLICE (1 << 16)
+
+/* At most this many runs are merged at once; more are first merged in
+ * groups into longer runs. */
+#define SPIMI_FAN_IN 64
+
+int buildIndexFile(char *indexPath, char **paths, int pathCount, Dict *stopWords, int threads, long budget);
+
+#endif
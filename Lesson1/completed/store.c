@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "store.h"
+#include "rank.h"
+
+/* Fills header for an index file with wordCount terms, the documents of
+ * index, the given sizes of the key and posting sections and fst. */
+void makeIndexHeader(IndexHeader *header, int wordCount, Index *index, unsigned long long keyBytes,
+                     unsigned long long postingBytes, Fst *fst)
+{
+    int docCount = index->docCount;
+    unsigned long long nameBytes = 0;
+    for (int d = 0; d < docCount; d++)
+        nameBytes += strlen(index->docNames[d]) + 1;
+
+    memset(header, 0, sizeof(IndexHeader));
+    memcpy(header->magic, INDEX_MAGIC, sizeof(header->magic));
+    header->version = INDEX_VERSION;
+    header->wordCount = wordCount;
+    header->rowCount = index->rowCount;
+    header->docCount = docCount;
+    header->termsOffset = sizeof(IndexHeader);
+    header->docsOffset = header->termsOffset + (unsigned long long)wordCount * sizeof(TermEntry);
+    header->lengthsOffset = header->docsOffset + 2ULL * docCount * sizeof(unsigned long long) +
+                            (2ULL * docCount + 1) * sizeof(unsigned int);
+    header->keysOffset = header->lengthsOffset + (unsigned long long)index->rowCount * sizeof(unsigned short);
+    header->namesOffset = header->keysOffset + keyBytes;
+    header->postingsOffset = header->namesOffset + nameBytes;
+    header->fstOffset = header->postingsOffset + postingBytes;
+    header->fstRoot = fst->root;
+    header->fileSize = header->fstOffset + fst->size;
+}
+
+/* The document section, which follows the term table, and room for the
+ * row lengths, which finishIndexFile fills in. */
+void writeDocumentTables(FILE *fp, Index *index)
+{
+    int docCount = index->docCount;
+    fwrite(index->docBytes, sizeof(unsigned long long), docCount, fp);
+    fwrite(index->docCompleteBytes, sizeof(unsigned long long), docCount, fp);
+    fwrite(index->docFirstRows, sizeof(unsigned int), docCount, fp);
+    unsigned int nameOffset = 0;
+    for (int d = 0; d <= docCount; d++)
+    {
+        fwrite(&nameOffset, sizeof(nameOffset), 1, fp);
+        if (d < docCount)
+            nameOffset += strlen(index->docNames[d]) + 1;
+    }
+    unsigned short zeros[1024] = {0};
+    for (int row = 0; row < index->rowCount; row += 1024)
+        fwrite(zeros, sizeof(unsigned short), index->rowCount - row < 1024 ? index->rowCount - row : 1024, fp);
+}
+
+/* The name section, which follows the keys. */
+void writeDocumentNames(FILE *fp, Index *index)
+{
+    for (int d = 0; d < index->docCount; d++)
+        fwrite(index->docNames[d], strlen(index->docNames[d]) + 1, 1, fp);
+}
+
+/* Index files are written as fileName.tmp and renamed into place when
+ * complete, so whoever has the old file mapped, a running server for
+ * one, keeps a whole file and never sees a half written one. */
+FILE *createIndexFile(char *fileName, char **tempPath)
+{
+    *tempPath = malloc(strlen(fileName) + 5);
+    sprintf(*tempPath, "%s.tmp", fileName);
+    FILE *fp = fopen(*tempPath, "w+b");
+    if (fp == NULL)
+    {
+        free(*tempPath);
+        *tempPath = NULL;
+    }
+    return fp;
+}
+
+/* Closes fp and renames it to fileName if it was written through and ok
+ * is set, or removes it. */
+int publishIndexFile(FILE *fp, char *fileName, char *tempPath, int ok)
+{
+    if (ferror(fp))
+        ok = 0;
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (ok && rename(tempPath, fileName) != 0)
+        ok = 0;
+    if (!ok)
+        remove(tempPath);
+    free(tempPath);
+    return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+/* Fills in what ranked queries need in the written index file open as
+ * fd: the length of every row, counted in postings and capped at the
+ * range of an unsigned short, and for every term the rows it occurs in
+ * and the row among them with the highest bm25Weight at this file's
+ * average row length. Storing that row's frequency and length rather
+ * than the weight lets a query recompute the bound exactly as it scores
+ * rows, so a row that only ties it can be skipped. Writers leave these
+ * zero since a merge only knows them once all postings are out; this
+ * one pass over the mapped file serves every writer. */
+static int fillRankingStatistics(int fd)
+{
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (unsigned long long)status.st_size < sizeof(IndexHeader))
+        return IO_ERROR;
+    char *data = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return IO_ERROR;
+    IndexHeader *header = (IndexHeader *)data;
+    TermEntry *terms = (TermEntry *)(data + header->termsOffset);
+    unsigned short *rowLengths = (unsigned short *)(data + header->lengthsOffset);
+    const unsigned char *postings = (unsigned char *)data + header->postingsOffset;
+
+    header->tokenCount = 0;
+    for (unsigned int t = 0; t < header->wordCount; t++)
+    {
+        const unsigned char *in = postings + terms[t].postingOffset;
+        unsigned int row = 0, gap, col;
+        for (unsigned int i = 0; i < terms[t].postingCount; i++)
+        {
+            in = getVarint(in, &gap);
+            in = getVarint(in, &col);
+            row += gap;
+            if (row >= 1 && row <= header->rowCount && rowLengths[row - 1] < USHRT_MAX)
+                rowLengths[row - 1]++;
+        }
+        header->tokenCount += terms[t].postingCount;
+    }
+
+    double averageLength = header->rowCount > 0 ? (double)header->tokenCount / header->rowCount : 1;
+    for (unsigned int t = 0; t < header->wordCount; t++)
+    {
+        const unsigned char *in = postings + terms[t].postingOffset;
+        unsigned int row = 0, rows = 0, gap, col;
+        double bound = -1;
+        for (unsigned int i = 0; i < terms[t].postingCount;)
+        {
+            in = getVarint(in, &gap);
+            in = getVarint(in, &col);
+            row += gap;
+            int frequency = 1;
+            i++;
+            while (i < terms[t].postingCount)
+            {
+                const unsigned char *next = getVarint(in, &gap);
+                if (gap != 0)
+                    break;
+                in = getVarint(next, &col);
+                frequency++;
+                i++;
+            }
+            int length = row >= 1 && row <= header->rowCount ? rowLengths[row - 1] : frequency;
+            if (frequency > BM25_MAX_FREQUENCY)
+                frequency = BM25_MAX_FREQUENCY;
+            double weight = bm25Weight(frequency, length, averageLength);
+            if (weight > bound)
+            {
+                bound = weight;
+                terms[t].boundFrequency = frequency;
+                terms[t].boundLength = length;
+            }
+            rows++;
+        }
+        terms[t].rowCount = rows;
+    }
+    int ok = msync(data, status.st_size, MS_SYNC) == 0;
+    munmap(data, status.st_size);
+    return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+/* publishIndexFile for an index file written through, once its ranking
+ * statistics are filled in. */
+int finishIndexFile(FILE *fp, char *fileName, char *tempPath, int ok)
+{
+    if (ok && (fflush(fp) != 0 || fillRankingStatistics(fileno(fp)) == IO_ERROR))
+        ok = 0;
+    return publishIndexFile(fp, fileName, tempPath, ok);
+}
+
+/* Writes the terms of index in the order given by order, which must be
+ * the sorted word ids produced by sortTable. */
+int writeIndexFile(char *fileName, Index *index, int *order)
+{
+    char *tempPath;
+    FILE *fp = createIndexFile(fileName, &tempPath);
+    if (fp == NULL)
+        return IO_ERROR;
+
+    int wordCount = index->dict.count;
+    unsigned long long keyBytes = 0;
+    unsigned long long postingBytes = 0;
+    long *encodedSizes = malloc((wordCount + 1) * sizeof(long));
+    int maxLength = 0;
+    FstBuilder builder;
+    Fst fst;
+    initFstBuilder(&builder);
+    for (int k = 0; k < wordCount; k++)
+        fstAdd(&builder, index->dict.keys[order[k]], index->dict.lengths[order[k]]);
+    finishFst(&builder, &fst);
+    for (int i = 0; i < wordCount; i++)
+    {
+        PostingList *list = &index->postings[i];
+        keyBytes += index->dict.lengths[i] + 1;
+        encodedSizes[i] = encodedPostingsSize(list->items, list->length);
+        postingBytes += encodedSizes[i];
+        if (list->length > maxLength)
+            maxLength = list->length;
+    }
+
+    IndexHeader header;
+    makeIndexHeader(&header, wordCount, index, keyBytes, postingBytes, &fst);
+    fwrite(&header, sizeof(header), 1, fp);
+
+    unsigned int keyOffset = 0;
+    unsigned long long postingOffset = 0;
+    for (int k = 0; k < wordCount; k++)
+    {
+        int i = order[k];
+        TermEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.keyOffset = keyOffset;
+        entry.keyLength = index->dict.lengths[i];
+        entry.type = index->types[i];
+        entry.postingCount = index->postings[i].length;
+        entry.postingOffset = postingOffset;
+        fwrite(&entry, sizeof(entry), 1, fp);
+        keyOffset += entry.keyLength + 1;
+        postingOffset += encodedSizes[i];
+    }
+
+    writeDocumentTables(fp, index);
+    for (int k = 0; k < wordCount; k++)
+    {
+        int i = order[k];
+        fwrite(index->dict.keys[i], index->dict.lengths[i] + 1, 1, fp);
+    }
+    writeDocumentNames(fp, index);
+
+    unsigned char *buffer = malloc((long)maxLength * 10 + 1);
+    for (int k = 0; k < wordCount; k++)
+    {
+        PostingList *list = &index->postings[order[k]];
+        long size = encodePostings(list->items, list->length, buffer);
+        fwrite(buffer, 1, size, fp);
+    }
+    fwrite(fst.bytes, 1, fst.size, fp);
+    free(buffer);
+    free(encodedSizes);
+    freeFstBuilder(&builder);
+    return finishIndexFile(fp, fileName, tempPath, 1);
+}
+
+/* Checks what lies past the header of the index file mapped in stored,
+ * so that a damaged file is refused when it is opened rather than read
+ * past its end by a query: every key and name lies in its section and
+ * ends with a NUL, documents start at rows of the index in order, the
+ * postings of each term are as many as its entry says and take up the
+ * bytes up to those of the next term, and the automaton is whole. */
+static int checkIndexFile(StoredIndex *stored)
+{
+    IndexHeader *header = stored->header;
+    unsigned long long keyBytes = header->namesOffset - header->keysOffset;
+    unsigned long long nameBytes = header->postingsOffset - header->namesOffset;
+    unsigned long long postingBytes = header->fstOffset - header->postingsOffset;
+
+    for (unsigned int d = 0; d < header->docCount; d++)
+    {
+        unsigned int start = stored->docNameOffsets[d], end = stored->docNameOffsets[d + 1];
+        if (start >= end || end > nameBytes || stored->names[end - 1] != '\0' ||
+            stored->docFirstRows[d] < 1 || stored->docFirstRows[d] > header->rowCount + 1ULL ||
+            (d > 0 && stored->docFirstRows[d] < stored->docFirstRows[d - 1]))
+            return IO_ERROR;
+    }
+
+    for (unsigned int t = 0; t < header->wordCount; t++)
+    {
+        TermEntry *entry = &stored->terms[t];
+        unsigned long long keyEnd = (unsigned long long)entry->keyOffset + entry->keyLength;
+        if (keyEnd >= keyBytes || stored->keys[keyEnd] != '\0')
+            return IO_ERROR;
+
+        unsigned long long end = t + 1 < header->wordCount ? stored->terms[t + 1].postingOffset : postingBytes;
+        if (entry->postingOffset > end || end > postingBytes)
+            return IO_ERROR;
+        /* the last byte of the postings ends a varint and exactly two
+         * varints a posting end before it, so decoding them stays there */
+        const unsigned char *in = stored->postings + entry->postingOffset;
+        const unsigned char *stop = stored->postings + end;
+        unsigned long long ends = 0;
+        for (const unsigned char *p = in; p < stop; p++)
+            ends += *p < 0x80;
+        if (ends != 2ULL * entry->postingCount || (in < stop && stop[-1] >= 0x80))
+            return IO_ERROR;
+    }
+
+    return fstCheck(&stored->fst, header->wordCount) ? IO_SUCCESS : IO_ERROR;
+}
+
+/* Maps fileName into stored and returns IO_ERROR, with nothing left
+ * open, if it is not an index file whole as writeIndexFile leaves it. */
+int openIndexFile(char *fileName, StoredIndex *stored)
+{
+    if (openInput(fileName, &stored->file) == IO_ERROR)
+        return IO_ERROR;
+
+    IndexHeader *header = (IndexHeader *)stored->file.data;
+    unsigned long long size = stored->file.size;
+    if (size < sizeof(IndexHeader) ||
+        memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != INDEX_VERSION ||
+        header->fileSize != size ||
+        header->termsOffset != sizeof(IndexHeader) ||
+        header->docsOffset != header->termsOffset + (unsigned long long)header->wordCount * sizeof(TermEntry) ||
+        header->lengthsOffset != header->docsOffset + 2ULL * header->docCount * sizeof(unsigned long long) +
+                                     (2ULL * header->docCount + 1) * sizeof(unsigned int) ||
+        header->keysOffset != header->lengthsOffset + (unsigned long long)header->rowCount * sizeof(unsigned short) ||
+        header->namesOffset < header->keysOffset ||
+        header->postingsOffset < header->namesOffset ||
+        header->fstOffset < header->postingsOffset ||
+        header->fstOffset > size ||
+        header->fstRoot >= size - header->fstOffset)
+    {
+        closeInput(&stored->file);
+        return IO_ERROR;
+    }
+
+    stored->header = header;
+    stored->terms = (TermEntry *)(stored->file.data + header->termsOffset);
+    stored->docBytes = (unsigned long long *)(stored->file.data + header->docsOffset);
+    stored->docCompleteBytes = stored->docBytes + header->docCount;
+    stored->docFirstRows = (unsigned int *)(stored->docCompleteBytes + header->docCount);
+    stored->docNameOffsets = stored->docFirstRows + header->docCount;
+    stored->rowLengths = (unsigned short *)(stored->file.data + header->lengthsOffset);
+    stored->keys = stored->file.data + header->keysOffset;
+    stored->names = stored->file.data + header->namesOffset;
+    stored->postings = (unsigned char *)stored->file.data + header->postingsOffset;
+    stored->fst.bytes = (unsigned char *)stored->file.data + header->fstOffset;
+    stored->fst.size = size - header->fstOffset;
+    stored->fst.root = header->fstRoot;
+    if (checkIndexFile(stored) == IO_ERROR)
+    {
+        closeInput(&stored->file);
+        return IO_ERROR;
+    }
+    return IO_SUCCESS;
+}
+
+void closeIndexFile(StoredIndex *stored)
+{
+    closeInput(&stored->file);
+}
+
+/* Binary search over the sorted term table; returns the term's position
+ * or -1. */
+int findTerm(StoredIndex *stored, const char *key, int len)
+{
+    int low = 0;
+    int high = (int)stored->header->wordCount - 1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        TermEntry *entry = &stored->terms[mid];
+        const char *term = stored->keys + entry->keyOffset;
+        int common = len < (int)entry->keyLength ? len : (int)entry->keyLength;
+        int cmp = memcmp(term, key, common);
+        if (cmp == 0)
+            cmp = (int)entry->keyLength - len;
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return -1;
+}
+
+/* Returns how many terms start with prefix; they are the ones from
+ * *first on in the term table. */
+int findPrefix(StoredIndex *stored, const char *prefix, int len, int *first)
+{
+    return fstPrefix(&stored->fst, prefix, len, first);
+}
+
+/* Decodes the postings of a term into out, which must have room for
+ * terms[term].postingCount entries. */
+void readTermPostings(StoredIndex *stored, int term, Posting *out)
+{
+    TermEntry *entry = &stored->terms[term];
+    decodePostings(stored->postings + entry->postingOffset, out, entry->postingCount);
+}
+
+/* Adds the rows a term occurs in to rows, decoding them straight from
+ * the file without the columns. */
+void readTermRows(StoredIndex *stored, int term, RowSet *rows)
+{
+    TermEntry *entry = &stored->terms[term];
+    const unsigned char *in = stored->postings + entry->postingOffset;
+    unsigned int row = 0, gap, col;
+    for (unsigned int i = 0; i < entry->postingCount; i++)
+    {
+        in = getVarint(in, &gap);
+        in = getVarint(in, &col);
+        row += gap;
+        addRow(rows, row);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stdio.h>
+
+#include "index.h"
+#include "input.h"
+#include "fst.h"
+#include "rowset.h"
+
+#define INDEX_MAGIC "KPLINDEX"
+#define INDEX_VERSION 5
+
+/* On-disk layout, all integers in host byte order:
+ *   IndexHeader
+ *   TermEntry[wordCount]           sorted by key (strcmp order)
+ *   unsigned long long[docCount]   indexed bytes of each document
+ *   unsigned long long[docCount]   end of its last complete row
+ *   unsigned int[docCount]         first row of each document
+ *   unsigned int[docCount + 1]     document name offsets
+ *   unsigned short[rowCount]       indexed words of each row
+ *   key bytes                      each key NUL terminated
+ *   name bytes                     each name NUL terminated
+ *   posting bytes                  encodePostings output, grouped by term
+ *   automaton bytes                Fst over the keys, root at fstRoot
+ */
+struct IndexHeader_
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int wordCount;
+    unsigned int rowCount;
+    unsigned int docCount;
+    unsigned long long termsOffset;
+    unsigned long long docsOffset;
+    unsigned long long lengthsOffset;
+    unsigned long long keysOffset;
+    unsigned long long namesOffset;
+    unsigned long long postingsOffset;
+    unsigned long long fstOffset;
+    unsigned long long fstRoot; /* from fstOffset */
+    unsigned long long tokenCount; /* postings of all terms */
+    unsigned long long fileSize;
+};
+
+typedef struct IndexHeader_ IndexHeader;
+
+struct TermEntry_
+{
+    unsigned int keyOffset; /* from keysOffset */
+    unsigned int keyLength;
+    unsigned int type;
+    unsigned int postingCount;
+    unsigned long long postingOffset; /* bytes from postingsOffset */
+    unsigned int rowCount; /* rows it occurs in */
+    /* the frequency and length of the row it gets the highest
+     * bm25Weight in, see rank.h, which bounds its score */
+    unsigned short boundFrequency;
+    unsigned short boundLength;
+};
+
+typedef struct TermEntry_ TermEntry;
+
+/* A read-only view of an index file mapped into memory. */
+struct StoredIndex_
+{
+    InputBuffer file;
+    IndexHeader *header;
+    TermEntry *terms;
+    unsigned long long *docBytes;
+    unsigned long long *docCompleteBytes;
+    unsigned int *docFirstRows;
+    unsigned int *docNameOffsets;
+    unsigned short *rowLengths;
+    char *keys;
+    char *names;
+    unsigned char *postings;
+    Fst fst;
+};
+
+typedef struct StoredIndex_ StoredIndex;
+
+FILE *createIndexFile(char *fileName, char **tempPath);
+int publishIndexFile(FILE *fp, char *fileName, char *tempPath, int ok);
+int finishIndexFile(FILE *fp, char *fileName, char *tempPath, int ok);
+void makeIndexHeader(IndexHeader *header, int wordCount, Index *index, unsigned long long keyBytes,
+                     unsigned long long postingBytes, Fst *fst);
+void writeDocumentTables(FILE *fp, Index *index);
+void writeDocumentNames(FILE *fp, Index *index);
+int writeIndexFile(char *fileName, Index *index, int *order);
+int openIndexFile(char *fileName, StoredIndex *stored);
+void closeIndexFile(StoredIndex *stored);
+
+int findTerm(StoredIndex *stored, const char *key, int len);
+int findPrefix(StoredIndex *stored, const char *prefix, int len, int *first);
+void readTermPostings(StoredIndex *stored, int term, Posting *out);
+void readTermRows(StoredIndex *stored, int term, RowSet *rows);
+
+#endif
@@ -0,0 +1,616 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "table.h"
+#include "sort.h"
+#include "input.h"
+#include "tokenizer.h"
+
+char *VAN_BAN_PATH = "vanban.txt";
+char *STOPW_PATH = "stopw.txt";
+
+Dict stopWords;
+Index table;
+int *order;
+int threadCount;
+char **documentPaths;
+int documentCount;
+OutputWriter output;
+int outputFormat = FORMAT_TEXT;
+
+int numberOfOccurences(int wordIndex)
+{
+    return table.postings[wordIndex].length;
+}
+
+void readFileStopWord(char *fileName)
+{
+    initDict(&stopWords);
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL)
+    {
+        printf("Cannot open file %s\n", fileName);
+        return;
+    }
+
+    char word[MAX_WORD_LENGTH];
+    char folded[MAX_WORD_LENGTH];
+    while (fscanf(fp, "%49s", word) != EOF)
+    {
+        int len = foldWord(word, folded);
+        dictInsert(&stopWords, folded, len, NULL);
+    }
+    fclose(fp);
+}
+
+/* Adds the paths listed in fileName, one per line, to documentPaths. */
+void readFileList(char *fileName)
+{
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL)
+    {
+        printf("Cannot open file %s\n", fileName);
+        return;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, fp)) != -1)
+    {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = '\0';
+        if (length == 0)
+            continue;
+        documentPaths = realloc(documentPaths, (documentCount + 1) * sizeof(char *));
+        documentPaths[documentCount++] = strdup(line);
+    }
+    free(line);
+    fclose(fp);
+}
+
+/* Indexes every document of documentPaths, skipping the stop words
+ * readFileStopWord has loaded. */
+void buildTable()
+{
+    initIndex(&table);
+    for (int d = 0; d < documentCount; d++)
+    {
+        InputBuffer input;
+        if (openTextInput(documentPaths[d], &input) == IO_ERROR)
+        {
+            printf("Cannot open file %s\n", documentPaths[d]);
+            continue;
+        }
+        addDocument(&table, documentPaths[d], input.size, completeLinesSize(input.data, input.size));
+        indexTextParallel(&table, &stopWords, input.data, input.size, threadCount);
+        closeInput(&input);
+    }
+}
+
+static void sketchToken(Token *token, void *context)
+{
+    if (!isBanned(&stopWords, token->text, token->length))
+        countWord(context, token->text, token->length);
+}
+
+/* Counts the words of documentPaths in sketch, without building the
+ * table, so memory stays bounded by the sketch whatever the input. */
+void sketchTable(SpaceSaving *sketch)
+{
+    for (int d = 0; d < documentCount; d++)
+    {
+        InputBuffer input;
+        if (openTextInput(documentPaths[d], &input) == IO_ERROR)
+        {
+            printf("Cannot open file %s\n", documentPaths[d]);
+            continue;
+        }
+        tokenizeText(input.data, input.size, 1, sketchToken, sketch);
+        closeInput(&input);
+    }
+}
+
+void sortTable()
+{
+    order = malloc(table.dict.count * sizeof(int));
+    for (int i = 0; i < table.dict.count; i++)
+        order[i] = i;
+    sortWordIds(order, table.dict.count, table.dict.keys);
+}
+
+/* Positions print as (line, col) for a single document and as
+ * (document, line, col) for a corpus. */
+void printPositions(OutputWriter *out, Posting *positions, int count, unsigned int *docFirstRows, int docCount)
+{
+    int doc = 0;
+    for (int j = 0; j < count; j++)
+    {
+        unsigned int row = postingRow(positions[j]);
+        writeString(out, " (");
+        if (docCount > 1)
+        {
+            while (doc + 1 < docCount && docFirstRows[doc + 1] <= row)
+                doc++;
+            writeUnsigned(out, doc);
+            writeString(out, ", ");
+            row = row - docFirstRows[doc] + 1;
+        }
+        writeUnsigned(out, row);
+        writeString(out, ", ");
+        writeUnsigned(out, postingCol(positions[j]));
+        writeChar(out, ')');
+    }
+    writeChar(out, '\n');
+}
+
+void printWord(OutputWriter *out, const char *word, int type, Posting *positions, int count,
+               unsigned int *docFirstRows, int docCount)
+{
+    writePadded(out, word, 15);
+    writeString(out, " Appear: ");
+    writeSigned(out, count);
+    writeString(out, " Type: ");
+    writeSigned(out, type);
+    writeString(out, " Positions:");
+    printPositions(out, positions, count, docFirstRows, docCount);
+}
+
+/* {"word":"...","count":n,"type":t,"positions":[[line,col],...]}, with
+ * [document,line,col] positions for a corpus. */
+void printWordJson(OutputWriter *out, const char *word, int type, Posting *positions, int count,
+                   unsigned int *docFirstRows, int docCount)
+{
+    writeString(out, "{\"word\":");
+    writeJsonString(out, word);
+    writeString(out, ",\"count\":");
+    writeSigned(out, count);
+    writeString(out, ",\"type\":");
+    writeSigned(out, type);
+    writeString(out, ",\"positions\":[");
+    int doc = 0;
+    for (int j = 0; j < count; j++)
+    {
+        unsigned int row = postingRow(positions[j]);
+        writeString(out, j == 0 ? "[" : ",[");
+        if (docCount > 1)
+        {
+            while (doc + 1 < docCount && docFirstRows[doc + 1] <= row)
+                doc++;
+            writeUnsigned(out, doc);
+            writeChar(out, ',');
+            row = row - docFirstRows[doc] + 1;
+        }
+        writeUnsigned(out, row);
+        writeChar(out, ',');
+        writeUnsigned(out, postingCol(positions[j]));
+        writeChar(out, ']');
+    }
+    writeString(out, "]}\n");
+}
+
+/* Streams the rows of a boolean query as they are found, from one cursor
+ * per segment of set, as line numbers or as (document, line) for a
+ * corpus. */
+void printRows(OutputWriter *out, const char *query, SegmentSet *set, RowCursor **cursors)
+{
+    writePadded(out, query, 15);
+    writeString(out, " Lines:");
+    int doc = 0;
+    for (int s = 0; s < set->count; s++)
+    {
+        for (int local = nextRow(cursors[s]); local != ROW_END; local = nextRow(cursors[s]))
+        {
+            unsigned int row = set->rowBases[s] + local;
+            if (set->docCount <= 1)
+            {
+                writeChar(out, ' ');
+                writeUnsigned(out, row);
+                continue;
+            }
+            while (doc + 1 < set->docCount && set->docFirstRows[doc + 1] <= row)
+                doc++;
+            writeString(out, " (");
+            writeUnsigned(out, doc);
+            writeString(out, ", ");
+            writeUnsigned(out, row - set->docFirstRows[doc] + 1);
+            writeChar(out, ')');
+        }
+    }
+    writeChar(out, '\n');
+}
+
+/* Steps through the union of the term ranges of the segments, from
+ * positions up to ends, in key order: sets key and the occurrences of
+ * the next key over all segments and moves past it. Returns 0 at the
+ * end. A position is a term number, or an index into terms[s] when the
+ * terms of segment s are listed there. */
+static int nextCompletion(SegmentSet *set, int **terms, int *positions, int *ends, const char **key,
+                          unsigned int *occurrences)
+{
+    *key = NULL;
+    for (int s = 0; s < set->count; s++)
+    {
+        if (positions[s] == ends[s])
+            continue;
+        StoredIndex *stored = &set->segments[s];
+        int term = terms != NULL && terms[s] != NULL ? terms[s][positions[s]] : positions[s];
+        const char *candidate = stored->keys + stored->terms[term].keyOffset;
+        if (*key == NULL || strcmp(candidate, *key) < 0)
+            *key = candidate;
+    }
+    if (*key == NULL)
+        return 0;
+    const char *found = *key;
+    *occurrences = 0;
+    for (int s = 0; s < set->count; s++)
+    {
+        if (positions[s] == ends[s])
+            continue;
+        StoredIndex *stored = &set->segments[s];
+        int term = terms != NULL && terms[s] != NULL ? terms[s][positions[s]] : positions[s];
+        TermEntry *entry = &stored->terms[term];
+        if (strcmp(stored->keys + entry->keyOffset, found) == 0)
+        {
+            *occurrences += entry->postingCount;
+            positions[s]++;
+        }
+    }
+    return 1;
+}
+
+/* The terms that a prefix or fuzzy query expands to, each with its
+ * number of occurrences: in each segment counts[s] of them, from
+ * firsts[s] on, or those listed in terms[s] if terms is not NULL, with
+ * the counts of a term found in several segments added up. */
+void printCompletions(OutputWriter *out, const char *query, SegmentSet *set, int **terms, int *firsts, int *counts)
+{
+    int *positions = malloc((set->count + 1) * sizeof(int));
+    int *ends = malloc((set->count + 1) * sizeof(int));
+    const char *key;
+    unsigned int occurrences;
+    int count = 0;
+    for (int s = 0; s < set->count; s++)
+    {
+        positions[s] = firsts[s];
+        ends[s] = firsts[s] + counts[s];
+    }
+    while (nextCompletion(set, terms, positions, ends, &key, &occurrences))
+        count++;
+
+    writePadded(out, query, 15);
+    writeString(out, " Terms: ");
+    writeSigned(out, count);
+    for (int s = 0; s < set->count; s++)
+        positions[s] = firsts[s];
+    while (nextCompletion(set, terms, positions, ends, &key, &occurrences))
+    {
+        writeChar(out, ' ');
+        writeString(out, key);
+        writeChar(out, '(');
+        writeUnsigned(out, occurrences);
+        writeChar(out, ')');
+    }
+    writeChar(out, '\n');
+    free(positions);
+    free(ends);
+}
+
+/* The rows of a ranked query, best first, each with its score. */
+void printRanked(OutputWriter *out, const char *query, SegmentSet *set, RankedRow *top, int count)
+{
+    writePadded(out, query, 15);
+    writeString(out, " Top: ");
+    writeSigned(out, count);
+    for (int i = 0; i < count; i++)
+    {
+        char score[32];
+        snprintf(score, sizeof(score), "%.3f", top[i].score);
+        if (set->docCount <= 1)
+        {
+            writeChar(out, ' ');
+            writeUnsigned(out, top[i].row);
+        }
+        else
+        {
+            int doc = findDocument(set->docFirstRows, set->docCount, top[i].row);
+            writeString(out, " (");
+            writeUnsigned(out, doc);
+            writeString(out, ", ");
+            writeUnsigned(out, top[i].row - set->docFirstRows[doc] + 1);
+            writeChar(out, ')');
+        }
+        writeChar(out, ':');
+        writeString(out, score);
+    }
+    writeChar(out, '\n');
+}
+
+/* Adds rowBase to the rows of count postings. */
+static void shiftRows(Posting *postings, int count, unsigned int rowBase)
+{
+    for (int i = 0; i < count && rowBase > 0; i++)
+        postings[i] = makePosting(postingRow(postings[i]) + rowBase, postingCol(postings[i]));
+}
+
+/* Answers one query against the segments of set, in one line. A query
+ * without spaces looks up one word, or lists the words that start with
+ * it if it ends in '*' and those a few edits from it if it ends in '~'
+ * or '~d'. One with AND, OR, NOT or parentheses lists the
+ * matching lines, and "RANK/k words" the k lines that score highest for
+ * the words; anything else is a phrase or proximity query for runQuery,
+ * which needs the stop words. Each segment is queried on its
+ * own, in row order, and the answers are joined with their rows moved
+ * to those of the whole index; no match spans two segments, since a
+ * document lies in one. */
+void printQuery(OutputWriter *out, SegmentSet *set, Dict *stopWords, const char *query)
+{
+    int count = set->count;
+    if (isRankQuery(query))
+    {
+        RankedRow *top = malloc(MAX_RANK_COUNT * sizeof(RankedRow));
+        int found = 0;
+        if (runRankQuery(set, query, top, &found) == IO_ERROR)
+        {
+            writePadded(out, query, 15);
+            writeString(out, " Bad query\n");
+        }
+        else
+            printRanked(out, query, set, top, found);
+        free(top);
+        return;
+    }
+    if (isBooleanQuery(query))
+    {
+        RowCursor **cursors = malloc((count + 1) * sizeof(RowCursor *));
+        int bad = 0;
+        for (int s = 0; s < count; s++)
+        {
+            cursors[s] = parseBooleanQuery(&set->segments[s], query);
+            bad |= cursors[s] == NULL;
+        }
+        if (bad)
+        {
+            writePadded(out, query, 15);
+            writeString(out, " Bad query\n");
+        }
+        else
+            printRows(out, query, set, cursors);
+        for (int s = 0; s < count; s++)
+            if (cursors[s] != NULL)
+                freeRowCursor(cursors[s]);
+        free(cursors);
+        return;
+    }
+    if (isPhraseQuery(query))
+    {
+        MatchList all = {NULL, 0, 0};
+        int bad = 0;
+        for (int s = 0; s < count; s++)
+        {
+            MatchList matches;
+            if (runQuery(&set->segments[s], stopWords, query, &matches) == IO_ERROR)
+            {
+                bad = 1;
+                break;
+            }
+            shiftRows(matches.items, matches.length, set->rowBases[s]);
+            all.items = realloc(all.items, (all.length + matches.length + 1) * sizeof(Posting));
+            memcpy(all.items + all.length, matches.items, matches.length * sizeof(Posting));
+            all.length += matches.length;
+            all.width = matches.width;
+            freeMatchList(&matches);
+        }
+        writePadded(out, query, 15);
+        if (bad)
+            writeString(out, " Bad query\n");
+        else
+        {
+            writeString(out, " Appear: ");
+            writeSigned(out, all.length);
+            writeString(out, " Positions:");
+            printPositions(out, all.items, all.length, set->docFirstRows, set->docCount);
+        }
+        free(all.items);
+        return;
+    }
+    int len = strlen(query);
+    if (len > 0 && query[len - 1] == '*')
+    {
+        int *firsts = calloc(count + 1, sizeof(int));
+        int *counts = malloc((count + 1) * sizeof(int));
+        for (int s = 0; s < count; s++)
+            counts[s] = findPrefix(&set->segments[s], query, len - 1, &firsts[s]);
+        printCompletions(out, query, set, NULL, firsts, counts);
+        free(firsts);
+        free(counts);
+        return;
+    }
+    int wordLength, maxDistance;
+    if (parseFuzzyWord(query, len, &wordLength, &maxDistance))
+    {
+        int **terms = malloc((count + 1) * sizeof(int *));
+        int *firsts = calloc(count + 1, sizeof(int));
+        int *counts = malloc((count + 1) * sizeof(int));
+        for (int s = 0; s < count; s++)
+        {
+            FuzzyTerm *matches;
+            counts[s] = findFuzzyTerms(&set->segments[s], query, wordLength, maxDistance, &matches);
+            terms[s] = malloc((counts[s] + 1) * sizeof(int));
+            for (int i = 0; i < counts[s]; i++)
+                terms[s][i] = matches[i].term;
+            free(matches);
+        }
+        printCompletions(out, query, set, terms, firsts, counts);
+        for (int s = 0; s < count; s++)
+            free(terms[s]);
+        free(terms);
+        free(firsts);
+        free(counts);
+        return;
+    }
+
+    int *found = malloc((count + 1) * sizeof(int));
+    int total = 0, last = -1;
+    for (int s = 0; s < count; s++)
+    {
+        found[s] = findTerm(&set->segments[s], query, len);
+        if (found[s] >= 0)
+        {
+            total += set->segments[s].terms[found[s]].postingCount;
+            last = s;
+        }
+    }
+    if (last < 0)
+    {
+        writePadded(out, query, 15);
+        writeString(out, " Not found\n");
+        free(found);
+        return;
+    }
+    Posting *positions = malloc((total + 1) * sizeof(Posting));
+    int length = 0;
+    for (int s = 0; s < count; s++)
+    {
+        if (found[s] < 0)
+            continue;
+        StoredIndex *stored = &set->segments[s];
+        readTermPostings(stored, found[s], positions + length);
+        shiftRows(positions + length, stored->terms[found[s]].postingCount, set->rowBases[s]);
+        length += stored->terms[found[s]].postingCount;
+    }
+    StoredIndex *stored = &set->segments[last];
+    TermEntry *entry = &stored->terms[found[last]];
+    printWord(out, stored->keys + entry->keyOffset, entry->type, positions, total, set->docFirstRows, set->docCount);
+    free(positions);
+    free(found);
+}
+
+void printDocuments(char **names, int docCount)
+{
+    if (docCount <= 1)
+        return;
+    writeString(&output, "Documents:\n");
+    for (int d = 0; d < docCount; d++)
+    {
+        writeUnsigned(&output, d);
+        writeString(&output, ": ");
+        writeString(&output, names[d]);
+        writeChar(&output, '\n');
+    }
+    writeChar(&output, '\n');
+}
+
+/* The k most frequent words, picked with a k-entry heap instead of
+ * sorting the whole table. */
+void printTopWords(int k)
+{
+    if (k > table.dict.count)
+        k = table.dict.count;
+    int *top = malloc((k + 1) * sizeof(int));
+    int count = topWords(&table, k, top);
+    for (int i = 0; i < count; i++)
+    {
+        writePadded(&output, table.dict.keys[top[i]], 15);
+        writeString(&output, " Appear: ");
+        writeSigned(&output, numberOfOccurences(top[i]));
+        writeString(&output, " Type: ");
+        writeSigned(&output, table.types[top[i]]);
+        writeChar(&output, '\n');
+    }
+    flushOutput(&output);
+    free(top);
+}
+
+/* Error is how far the count may be above the true one. */
+void printSketchTop(SpaceSaving *sketch, int k)
+{
+    int *top = malloc((k + 1) * sizeof(int));
+    int count = topSketchWords(sketch, k, top);
+    for (int i = 0; i < count; i++)
+    {
+        SketchCounter *counter = &sketch->counters[top[i]];
+        writePadded(&output, counter->key, 15);
+        writeString(&output, " Appear: ");
+        writeSigned(&output, counter->count);
+        writeString(&output, " Error: ");
+        writeSigned(&output, counter->error);
+        writeChar(&output, '\n');
+    }
+    flushOutput(&output);
+    free(top);
+}
+
+/* The binary dump: DUMP_MAGIC, then as LEB128 varints the document
+ * count and for each document its first row, name length and name
+ * bytes, then the word count and for each word in order its key length,
+ * key bytes, type, posting count and the postings as encodePostings
+ * writes them. */
+void printTableBinary()
+{
+    writeBytes(&output, DUMP_MAGIC, 8);
+    writeVarint(&output, table.docCount);
+    for (int d = 0; d < table.docCount; d++)
+    {
+        int len = strlen(table.docNames[d]);
+        writeVarint(&output, table.docFirstRows[d]);
+        writeVarint(&output, len);
+        writeBytes(&output, table.docNames[d], len);
+    }
+    writeVarint(&output, table.dict.count);
+    unsigned char *encoded = NULL;
+    long encodedCapacity = 0;
+    for (int k = 0; k < table.dict.count; k++)
+    {
+        int i = order[k];
+        PostingList *list = &table.postings[i];
+        long size = encodedPostingsSize(list->items, list->length);
+        if (size > encodedCapacity)
+        {
+            encodedCapacity = size;
+            encoded = realloc(encoded, encodedCapacity);
+        }
+        encodePostings(list->items, list->length, encoded);
+        writeVarint(&output, table.dict.lengths[i]);
+        writeBytes(&output, table.dict.keys[i], table.dict.lengths[i]);
+        writeVarint(&output, table.types[i]);
+        writeVarint(&output, list->length);
+        writeBytes(&output, encoded, size);
+    }
+    free(encoded);
+}
+
+void printTable()
+{
+    if (outputFormat == FORMAT_BINARY)
+        printTableBinary();
+    else if (outputFormat == FORMAT_JSONL)
+    {
+        writeString(&output, "{\"documents\":[");
+        for (int d = 0; d < table.docCount; d++)
+        {
+            if (d > 0)
+                writeChar(&output, ',');
+            writeJsonString(&output, table.docNames[d]);
+        }
+        writeString(&output, "]}\n");
+        for (int k = 0; k < table.dict.count; k++)
+        {
+            int i = order[k];
+            printWordJson(&output, table.dict.keys[i], table.types[i], table.postings[i].items,
+                          numberOfOccurences(i), table.docFirstRows, table.docCount);
+        }
+    }
+    else
+    {
+        writeString(&output, "0: normal\n1: proper noun\n2: integer\n3: real number\n\n");
+        printDocuments(table.docNames, table.docCount);
+        for (int k = 0; k < table.dict.count; k++)
+        {
+            int i = order[k];
+            printWord(&output, table.dict.keys[i], table.types[i], table.postings[i].items,
+                      numberOfOccurences(i), table.docFirstRows, table.docCount);
+        }
+    }
+    flushOutput(&output);
+}
@@ -0,0 +1,52 @@
+#ifndef __TABLE_H__
+#define __TABLE_H__
+
+#include "index.h"
+#include "query.h"
+#include "segment.h"
+#include "rank.h"
+#include "fuzzy.h"
+#include "topk.h"
+#include "output.h"
+
+#define DUMP_MAGIC "KPLDUMP1"
+
+/* The word table of the documents named on the command line, built in
+ * the phases main runs one after the other: readFileStopWord,
+ * buildTable, sortTable and printTable. Everything printed goes through
+ * output, in outputFormat where there is a choice. */
+extern char *VAN_BAN_PATH;
+extern char *STOPW_PATH;
+
+extern Dict stopWords;
+extern Index table;
+extern int *order;
+extern int threadCount;
+extern char **documentPaths;
+extern int documentCount;
+extern OutputWriter output;
+extern int outputFormat;
+
+int numberOfOccurences(int wordIndex);
+void readFileStopWord(char *fileName);
+void readFileList(char *fileName);
+void buildTable();
+void sketchTable(SpaceSaving *sketch);
+void sortTable();
+
+void printPositions(OutputWriter *out, Posting *positions, int count, unsigned int *docFirstRows, int docCount);
+void printWord(OutputWriter *out, const char *word, int type, Posting *positions, int count,
+               unsigned int *docFirstRows, int docCount);
+void printWordJson(OutputWriter *out, const char *word, int type, Posting *positions, int count,
+                   unsigned int *docFirstRows, int docCount);
+void printRows(OutputWriter *out, const char *query, SegmentSet *set, RowCursor **cursors);
+void printCompletions(OutputWriter *out, const char *query, SegmentSet *set, int **terms, int *firsts, int *counts);
+void printRanked(OutputWriter *out, const char *query, SegmentSet *set, RankedRow *top, int count);
+void printQuery(OutputWriter *out, SegmentSet *set, Dict *stopWords, const char *query);
+void printDocuments(char **names, int docCount);
+void printTopWords(int k);
+void printSketchTop(SpaceSaving *sketch, int k);
+void printTableBinary();
+void printTable();
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tokenizer.h"
+#include "unicode.h"
+
+/* Field properties, updated as each kept character is read. */
+#define F_DIGITS 1    /* only digits so far */
+#define F_ALPHA 2     /* only letters so far */
+#define F_REAL 4      /* a sign, then digits and periods, no period before a digit */
+#define F_HAS_DIGIT 8 /* a digit has been seen */
+#define F_START (F_DIGITS | F_ALPHA | F_REAL)
+
+CharClass charClasses[256] = {
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_NEWLINE, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_SPACE, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_COMMA, CLASS_MINUS, CLASS_PERIOD, CLASS_DROP,
+    CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT, CLASS_DIGIT,
+    CLASS_DIGIT, CLASS_DIGIT, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_DROP, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER,
+    CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER,
+    CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_UPPER,
+    CLASS_UPPER, CLASS_UPPER, CLASS_UPPER, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_DROP, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER,
+    CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER,
+    CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_LOWER,
+    CLASS_LOWER, CLASS_LOWER, CLASS_LOWER, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+
+    CLASS_DROP, CLASS_DROP, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8,
+    CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_UTF8, CLASS_DROP, CLASS_DROP, CLASS_DROP,
+    CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP, CLASS_DROP};
+
+static inline int nextFlags(int flags, int charClass, int position)
+{
+    switch (charClass)
+    {
+    case CLASS_UPPER:
+    case CLASS_LOWER:
+        return flags & F_ALPHA;
+    case CLASS_DIGIT:
+        return (flags & (F_DIGITS | F_REAL)) | F_HAS_DIGIT;
+    case CLASS_PERIOD:
+        return (flags & F_HAS_DIGIT) ? flags & (F_REAL | F_HAS_DIGIT) : 0;
+    case CLASS_MINUS:
+        return position == 0 ? flags & F_REAL : 0;
+    default:
+        return 0;
+    }
+}
+
+/* Length of the run of lower case letters starting at p. */
+static inline long lowerRunLength(const char *p, const char *end)
+{
+    const char *start = p;
+#ifdef __SSE2__
+    /* 'a'..'z' shifted down by 'a' + 128 are exactly the bytes below -102 */
+    const __m128i shift = _mm_set1_epi8((char)('a' + 128));
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    while (end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_sub_epi8(bytes, shift), limit));
+        if (mask != 0xffff)
+            return p - start + __builtin_ctz(~mask);
+        p += 16;
+    }
+#endif
+    while (p < end && charClasses[(unsigned char)*p] == CLASS_LOWER)
+        p++;
+    return p - start;
+}
+
+static void reserveCopy(char **copy, int *capacity, int length)
+{
+    if (length > *capacity)
+    {
+        *capacity = *capacity == 0 ? 64 : *capacity;
+        while (length > *capacity)
+            *capacity *= 2;
+        *copy = realloc(*copy, *capacity);
+    }
+}
+
+/* Splits text[0..size) into rows at '\n' and fields at ' ', numbering rows
+ * from firstRow and fields from 1, and hands every word to handler in one
+ * pass over the bytes. Text is UTF-8: ASCII goes straight through the
+ * table and only multi-byte sequences are decoded and looked up with
+ * unicodeClass. Characters of class CLASS_DROP, and malformed bytes, are
+ * ignored as if they were not there. A field that is not a number is cut
+ * before its first ',' and before its first '.' not followed by a capital
+ * letter. A word is a proper noun when it starts with a capital letter
+ * and follows a non-empty field of the same row that does not end in '.'.
+ * Returns the number of rows in text. */
+long tokenizeText(const char *text, long size, int firstRow, TokenHandler handler, void *context)
+{
+    const char *p = text;
+    const char *end = text + size;
+    char *copy = NULL;
+    int copyCapacity = 0;
+    int row = firstRow;
+    int col = 1;
+    int prevNonEmpty = 0;
+    int prevPeriod = 0;
+
+    while (1)
+    {
+        const char *fieldStart = p;
+        int length = 0;
+        int gap = 0;     /* a dropped character sits between kept ones */
+        int copying = 0; /* so the kept characters are gathered in copy */
+        int flags = F_START;
+        int firstClass = CLASS_DROP;
+        int lastClass = CLASS_DROP;
+        int cutLength = -1, cutFlags = 0;
+        int periodAt = -1, periodFlags = 0;
+
+        while (p < end)
+        {
+            int charClass = charClasses[(unsigned char)*p];
+            int width = 1;
+            if (charClass == CLASS_SPACE || charClass == CLASS_NEWLINE)
+                break;
+            if (charClass == CLASS_UTF8)
+            {
+                unsigned int codePoint;
+                width = decodeUtf8((const unsigned char *)p, (const unsigned char *)end, &codePoint);
+                if (width == 0)
+                {
+                    width = 1;
+                    charClass = CLASS_DROP;
+                }
+                else
+                    charClass = unicodeClass(codePoint);
+            }
+            if (charClass == CLASS_DROP)
+            {
+                if (length == 0)
+                    fieldStart = p + width;
+                else
+                    gap = 1;
+                p += width;
+                continue;
+            }
+
+            if (cutLength < 0)
+            {
+                if (periodAt >= 0)
+                {
+                    if (charClass == CLASS_UPPER)
+                        periodAt = -1;
+                    else
+                    {
+                        cutLength = periodAt;
+                        cutFlags = periodFlags;
+                    }
+                }
+                if (cutLength < 0 && charClass == CLASS_COMMA)
+                {
+                    cutLength = length;
+                    cutFlags = flags;
+                }
+                else if (cutLength < 0 && charClass == CLASS_PERIOD)
+                {
+                    periodAt = length;
+                    periodFlags = flags;
+                }
+            }
+            flags = nextFlags(flags, charClass, length);
+
+            if (gap && !copying)
+            {
+                reserveCopy(&copy, &copyCapacity, length + width);
+                memcpy(copy, fieldStart, length);
+                copying = 1;
+            }
+            if (copying)
+            {
+                reserveCopy(&copy, &copyCapacity, length + width);
+                memcpy(copy + length, p, width);
+            }
+            if (length == 0)
+                firstClass = charClass;
+            length += width;
+            lastClass = charClass;
+            p += width;
+
+            if (charClass == CLASS_LOWER)
+            {
+                long run = lowerRunLength(p, end);
+                if (copying)
+                {
+                    reserveCopy(&copy, &copyCapacity, length + run);
+                    memcpy(copy + length, p, run);
+                }
+                length += run;
+                p += run;
+            }
+        }
+
+        if (cutLength < 0 && periodAt >= 0)
+        {
+            cutLength = periodAt;
+            cutFlags = periodFlags;
+        }
+        int isNumber = (flags & F_DIGITS) || (flags & (F_REAL | F_HAS_DIGIT)) == (F_REAL | F_HAS_DIGIT);
+        if (!isNumber && cutLength >= 0)
+        {
+            length = cutLength;
+            flags = cutFlags;
+        }
+        if (length > 0)
+        {
+            Token token;
+            token.text = copying ? copy : fieldStart;
+            token.length = length;
+            token.row = row;
+            token.col = col;
+            if (prevNonEmpty && !prevPeriod && firstClass == CLASS_UPPER)
+                token.type = TYPE_PROPER_NOUN;
+            else if (flags & F_DIGITS)
+                token.type = TYPE_INTEGER;
+            else if ((flags & (F_REAL | F_HAS_DIGIT)) == (F_REAL | F_HAS_DIGIT))
+                token.type = TYPE_REAL;
+            else
+                token.type = TYPE_NORMAL;
+            handler(&token, context);
+        }
+        prevNonEmpty = lastClass != CLASS_DROP;
+        prevPeriod = lastClass == CLASS_PERIOD;
+
+        if (p >= end)
+            break;
+        if (*p == '\n')
+        {
+            row++;
+            col = 1;
+            prevNonEmpty = 0;
+            prevPeriod = 0;
+        }
+        else
+            col++;
+        p++;
+    }
+
+    free(copy);
+    if (size == 0)
+        return 0;
+    return text[size - 1] == '\n' ? row - firstRow : row - firstRow + 1;
+}
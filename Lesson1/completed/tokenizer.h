@@ -0,0 +1,40 @@
+#ifndef __TOKENIZER_H__
+#define __TOKENIZER_H__
+
+#define TYPE_NORMAL 0
+#define TYPE_PROPER_NOUN 1
+#define TYPE_INTEGER 2
+#define TYPE_REAL 3
+
+typedef enum
+{
+    CLASS_DROP,
+    CLASS_SPACE,
+    CLASS_NEWLINE,
+    CLASS_UPPER,
+    CLASS_LOWER,
+    CLASS_DIGIT,
+    CLASS_PERIOD,
+    CLASS_COMMA,
+    CLASS_MINUS,
+    CLASS_UTF8, /* lead byte of a multi-byte UTF-8 sequence */
+} CharClass;
+
+/* A classified word. text is not NUL terminated and is only valid until
+ * the handler returns. */
+struct Token_
+{
+    const char *text;
+    int length;
+    int row;
+    int col;
+    int type;
+};
+
+typedef struct Token_ Token;
+
+typedef void (*TokenHandler)(Token *token, void *context);
+
+long tokenizeText(const char *text, long size, int firstRow, TokenHandler handler, void *context);
+
+#endif
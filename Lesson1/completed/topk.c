@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "topk.h"
+
+/* Whether item a ranks below item b. */
+typedef int (*RanksBelow)(void *context, int a, int b);
+
+/* heap[0..size) is a min-heap: heap[0] ranks below everything else. */
+static void siftDown(int *heap, int size, int i, RanksBelow below, void *context)
+{
+    while (1)
+    {
+        int lowest = i;
+        int left = 2 * i + 1, right = left + 1;
+        if (left < size && below(context, heap[left], heap[lowest]))
+            lowest = left;
+        if (right < size && below(context, heap[right], heap[lowest]))
+            lowest = right;
+        if (lowest == i)
+            return;
+        int t = heap[i];
+        heap[i] = heap[lowest];
+        heap[lowest] = t;
+        i = lowest;
+    }
+}
+
+static void siftUp(int *heap, int i, RanksBelow below, void *context)
+{
+    while (i > 0 && below(context, heap[i], heap[(i - 1) / 2]))
+    {
+        int parent = (i - 1) / 2;
+        int t = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = t;
+        i = parent;
+    }
+}
+
+/* Keeps the best k of items 0..n-1 in a min-heap held in out, so each
+ * item costs one comparison with the weakest kept one and O(log k) when
+ * it replaces it, then heap-sorts out best first. Returns the number of
+ * items in out. */
+static int selectTop(int n, int k, int *out, RanksBelow below, void *context)
+{
+    if (k > n)
+        k = n;
+    if (k <= 0)
+        return 0;
+    int size = 0;
+    for (int item = 0; item < n; item++)
+    {
+        if (size < k)
+        {
+            out[size] = item;
+            siftUp(out, size++, below, context);
+        }
+        else if (below(context, out[0], item))
+        {
+            out[0] = item;
+            siftDown(out, size, 0, below, context);
+        }
+    }
+    for (int end = size - 1; end > 0; end--)
+    {
+        int t = out[0];
+        out[0] = out[end];
+        out[end] = t;
+        siftDown(out, end, 0, below, context);
+    }
+    return size;
+}
+
+static int wordRanksBelow(void *context, int a, int b)
+{
+    Index *index = context;
+    int countA = index->postings[a].length;
+    int countB = index->postings[b].length;
+    if (countA != countB)
+        return countA < countB;
+    return strcmp(index->dict.keys[a], index->dict.keys[b]) > 0;
+}
+
+/* Stores the ids of the k most frequent words of index in out, most
+ * frequent first, and returns how many there are. */
+int topWords(Index *index, int k, int *out)
+{
+    return selectTop(index->dict.count, k, out, wordRanksBelow, index);
+}
+
+void initSpaceSaving(SpaceSaving *sketch, int capacity)
+{
+    sketch->capacity = capacity;
+    sketch->size = 0;
+    sketch->total = 0;
+    sketch->counters = calloc(capacity, sizeof(SketchCounter));
+    sketch->buckets = malloc((capacity + 1) * sizeof(SketchBucket));
+    for (int i = 0; i <= capacity; i++)
+        sketch->buckets[i].next = i < capacity ? i + 1 : -1;
+    sketch->freeBucket = 0;
+    sketch->lowest = -1;
+    sketch->slotCapacity = 2;
+    while (sketch->slotCapacity < 2 * capacity)
+        sketch->slotCapacity *= 2;
+    sketch->slots = calloc(sketch->slotCapacity, sizeof(DictSlot));
+}
+
+void freeSpaceSaving(SpaceSaving *sketch)
+{
+    for (int i = 0; i < sketch->size; i++)
+        free(sketch->counters[i].key);
+    free(sketch->counters);
+    free(sketch->buckets);
+    free(sketch->slots);
+}
+
+/* Takes counter out of its bucket, dropping the bucket if it empties. */
+static void detachCounter(SpaceSaving *sketch, int index)
+{
+    SketchCounter *counter = &sketch->counters[index];
+    SketchBucket *bucket = &sketch->buckets[counter->bucket];
+    if (counter->prev >= 0)
+        sketch->counters[counter->prev].next = counter->next;
+    else
+        bucket->first = counter->next;
+    if (counter->next >= 0)
+        sketch->counters[counter->next].prev = counter->prev;
+    if (bucket->first >= 0)
+        return;
+
+    if (bucket->prev >= 0)
+        sketch->buckets[bucket->prev].next = bucket->next;
+    else
+        sketch->lowest = bucket->next;
+    if (bucket->next >= 0)
+        sketch->buckets[bucket->next].prev = bucket->prev;
+    bucket->next = sketch->freeBucket;
+    sketch->freeBucket = counter->bucket;
+}
+
+/* Puts counter, whose count has just been set, into the bucket for its
+ * count, which comes right after bucket after (-1 for the list head). */
+static void attachCounter(SpaceSaving *sketch, int index, int after)
+{
+    SketchCounter *counter = &sketch->counters[index];
+    int next = after >= 0 ? sketch->buckets[after].next : sketch->lowest;
+    int target = next;
+    if (next < 0 || sketch->buckets[next].count != counter->count)
+    {
+        target = sketch->freeBucket;
+        sketch->freeBucket = sketch->buckets[target].next;
+        SketchBucket *bucket = &sketch->buckets[target];
+        bucket->count = counter->count;
+        bucket->first = -1;
+        bucket->prev = after;
+        bucket->next = next;
+        if (after >= 0)
+            sketch->buckets[after].next = target;
+        else
+            sketch->lowest = target;
+        if (next >= 0)
+            sketch->buckets[next].prev = target;
+    }
+    SketchBucket *bucket = &sketch->buckets[target];
+    counter->bucket = target;
+    counter->prev = -1;
+    counter->next = bucket->first;
+    if (bucket->first >= 0)
+        sketch->counters[bucket->first].prev = index;
+    bucket->first = index;
+}
+
+/* Adds one to the count of counter, moving it one bucket up. */
+static void incrementCounter(SpaceSaving *sketch, int index)
+{
+    SketchCounter *counter = &sketch->counters[index];
+    int bucket = counter->bucket;
+    int alone = sketch->counters[index].prev < 0 && counter->next < 0;
+    int after = alone ? sketch->buckets[bucket].prev : bucket;
+    detachCounter(sketch, index);
+    counter->count++;
+    attachCounter(sketch, index, after);
+}
+
+/* The slot holding word, or the empty slot where it would go. */
+static int findSlot(SpaceSaving *sketch, const char *word, int len, unsigned int hash)
+{
+    int mask = sketch->slotCapacity - 1;
+    int i = hash & mask;
+    while (sketch->slots[i].id != 0)
+    {
+        SketchCounter *counter = &sketch->counters[sketch->slots[i].id - 1];
+        if (sketch->slots[i].hash == hash && counter->length == len && memcmp(counter->key, word, len) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Empties slot and moves later entries of its probe run back into the
+ * hole, so lookups never need tombstones. */
+static void removeSlot(SpaceSaving *sketch, int slot)
+{
+    int mask = sketch->slotCapacity - 1;
+    int hole = slot;
+    for (int i = (slot + 1) & mask; sketch->slots[i].id != 0; i = (i + 1) & mask)
+    {
+        int home = sketch->slots[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            sketch->slots[hole] = sketch->slots[i];
+            hole = i;
+        }
+    }
+    sketch->slots[hole].id = 0;
+}
+
+static void setKey(SketchCounter *counter, const char *word, int len, unsigned int hash)
+{
+    if (len + 1 > counter->keyCapacity)
+    {
+        counter->keyCapacity = len + 1;
+        counter->key = realloc(counter->key, counter->keyCapacity);
+    }
+    memcpy(counter->key, word, len);
+    counter->key[len] = '\0';
+    counter->length = len;
+    counter->hash = hash;
+}
+
+void countWord(SpaceSaving *sketch, const char *word, int len)
+{
+    unsigned int hash = hashWord(word, len);
+    int slot = findSlot(sketch, word, len, hash);
+    sketch->total++;
+    if (sketch->slots[slot].id != 0)
+    {
+        incrementCounter(sketch, sketch->slots[slot].id - 1);
+        return;
+    }
+
+    int index;
+    if (sketch->size < sketch->capacity)
+    {
+        index = sketch->size++;
+        SketchCounter *counter = &sketch->counters[index];
+        counter->count = 1;
+        counter->error = 0;
+        attachCounter(sketch, index, -1);
+    }
+    else
+    {
+        index = sketch->buckets[sketch->lowest].first;
+        SketchCounter *victim = &sketch->counters[index];
+        removeSlot(sketch, findSlot(sketch, victim->key, victim->length, victim->hash));
+        victim->error = victim->count;
+        incrementCounter(sketch, index);
+        slot = findSlot(sketch, word, len, hash);
+    }
+    setKey(&sketch->counters[index], word, len, hash);
+    sketch->slots[slot].hash = hash;
+    sketch->slots[slot].id = index + 1;
+}
+
+static int counterRanksBelow(void *context, int a, int b)
+{
+    SpaceSaving *sketch = context;
+    SketchCounter *counterA = &sketch->counters[a];
+    SketchCounter *counterB = &sketch->counters[b];
+    if (counterA->count != counterB->count)
+        return counterA->count < counterB->count;
+    return strcmp(counterA->key, counterB->key) > 0;
+}
+
+/* Stores the indices of the k counters with the highest counts in out,
+ * highest first, and returns how many there are. */
+int topSketchWords(SpaceSaving *sketch, int k, int *out)
+{
+    return selectTop(sketch->size, k, out, counterRanksBelow, sketch);
+}
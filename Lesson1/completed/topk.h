@@ -0,0 +1,64 @@
+#ifndef __TOPK_H__
+#define __TOPK_H__
+
+#include "dict.h"
+#include "index.h"
+
+/* The approximate mode keeps this many counters per word asked for. */
+#define SKETCH_FACTOR 8
+
+/* Ranks words by count, most frequent first, ties in strcmp order. */
+int topWords(Index *index, int k, int *out);
+
+/* A space-saving sketch: at most capacity counters, each a word with an
+ * estimate of its count. A word without a counter takes over the one
+ * with the lowest count, whose count it inherits as error. Every count
+ * is at most error above the true one, and any word seen more than
+ * total / capacity times is sure to hold a counter.
+ * Counters with the same count share a bucket and the buckets form a
+ * list in count order (the Stream-Summary layout), so counting a word
+ * moves its counter at most one bucket along, in constant time. */
+struct SketchCounter_
+{
+    char *key;
+    int length;
+    int keyCapacity;
+    unsigned int hash;
+    long count;
+    long error;
+    int bucket;
+    int prev, next; /* counters of the same bucket, -1 at the ends */
+};
+
+typedef struct SketchCounter_ SketchCounter;
+
+struct SketchBucket_
+{
+    long count;
+    int first;      /* a counter of this count */
+    int prev, next; /* buckets of the next lower and higher count */
+};
+
+typedef struct SketchBucket_ SketchBucket;
+
+struct SpaceSaving_
+{
+    SketchCounter *counters;
+    int capacity;
+    int size;
+    SketchBucket *buckets; /* one per distinct count, plus free ones */
+    int lowest;            /* bucket of the lowest count, -1 when empty */
+    int freeBucket;        /* chained through next */
+    DictSlot *slots;       /* counter index + 1 by key hash, linear probing */
+    int slotCapacity;
+    long total;
+};
+
+typedef struct SpaceSaving_ SpaceSaving;
+
+void initSpaceSaving(SpaceSaving *sketch, int capacity);
+void freeSpaceSaving(SpaceSaving *sketch);
+void countWord(SpaceSaving *sketch, const char *word, int len);
+int topSketchWords(SpaceSaving *sketch, int k, int *out);
+
+#endif
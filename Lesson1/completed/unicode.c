@@ -0,0 +1,315 @@
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "unicode.h"
+
+/* How many bytes of a UTF-16 text are looked at to guess its byte order
+ * when it has no byte order mark. */
+#define DETECT_SAMPLE_SIZE 4096
+
+/* Decodes one UTF-8 sequence at p. Returns its length, or 0 when the
+ * bytes are not well-formed UTF-8 (overlong forms and surrogates
+ * included). */
+int decodeUtf8(const unsigned char *p, const unsigned char *end, unsigned int *codePoint)
+{
+    unsigned int c = p[0];
+    int length;
+    unsigned int min;
+    if (c < 0x80)
+    {
+        *codePoint = c;
+        return 1;
+    }
+    else if (c >= 0xc2 && c <= 0xdf)
+    {
+        length = 2;
+        min = 0x80;
+        c &= 0x1f;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        length = 3;
+        min = 0x800;
+        c &= 0x0f;
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        length = 4;
+        min = 0x10000;
+        c &= 0x07;
+    }
+    else
+        return 0;
+
+    if (end - p < length)
+        return 0;
+    for (int i = 1; i < length; i++)
+    {
+        if ((p[i] & 0xc0) != 0x80)
+            return 0;
+        c = (c << 6) | (p[i] & 0x3f);
+    }
+    if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+        return 0;
+    *codePoint = c;
+    return length;
+}
+
+int encodeUtf8(unsigned int codePoint, char *out)
+{
+    if (codePoint < 0x80)
+    {
+        out[0] = codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800)
+    {
+        out[0] = 0xc0 | (codePoint >> 6);
+        out[1] = 0x80 | (codePoint & 0x3f);
+        return 2;
+    }
+    if (codePoint < 0x10000)
+    {
+        out[0] = 0xe0 | (codePoint >> 12);
+        out[1] = 0x80 | ((codePoint >> 6) & 0x3f);
+        out[2] = 0x80 | (codePoint & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (codePoint >> 18);
+    out[1] = 0x80 | ((codePoint >> 12) & 0x3f);
+    out[2] = 0x80 | ((codePoint >> 6) & 0x3f);
+    out[3] = 0x80 | (codePoint & 0x3f);
+    return 4;
+}
+
+/* Letter classes for the scripts we index: Latin (including all the
+ * Vietnamese letters), Greek and Cyrillic get upper and lower case,
+ * combining accents and caseless scripts count as lower case letters so
+ * they stay inside words, and everything else is dropped like ASCII
+ * punctuation. */
+CharClass unicodeClass(unsigned int c)
+{
+    if (c < 0x80)
+        return CLASS_DROP;
+    if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+        return CLASS_UPPER;
+    if (c >= 0xdf && c <= 0xff && c != 0xf7)
+        return CLASS_LOWER;
+    if (c == 0xaa || c == 0xb5 || c == 0xba)
+        return CLASS_LOWER;
+    if (c >= 0x100 && c <= 0x17f)
+        return unicodeToLower(c) != c ? CLASS_UPPER : CLASS_LOWER;
+    if (c >= 0x180 && c <= 0x24f)
+        return unicodeToLower(c) != c ? CLASS_UPPER : CLASS_LOWER;
+    if (c >= 0x300 && c <= 0x36f)
+        return CLASS_LOWER;
+    if (c >= 0x386 && c <= 0x3ff && c != 0x387)
+        return unicodeToLower(c) != c ? CLASS_UPPER : CLASS_LOWER;
+    if (c >= 0x400 && c <= 0x4ff)
+        return unicodeToLower(c) != c ? CLASS_UPPER : CLASS_LOWER;
+    if (c >= 0x1e00 && c <= 0x1eff)
+        return unicodeToLower(c) != c ? CLASS_UPPER : CLASS_LOWER;
+    if ((c >= 0x5d0 && c <= 0x5ea) || (c >= 0x620 && c <= 0x64a) ||
+        (c >= 0xe01 && c <= 0xe4e) || (c >= 0x3041 && c <= 0x30ff) ||
+        (c >= 0x3400 && c <= 0x4dbf) || (c >= 0x4e00 && c <= 0x9fff) ||
+        (c >= 0xac00 && c <= 0xd7a3))
+        return CLASS_LOWER;
+    return CLASS_DROP;
+}
+
+/* Capitals of Latin Extended-B and of the Greek and Coptic symbols with
+ * their lower case, in code point order: too irregular for the ranges in
+ * unicodeToLower. */
+static const unsigned short irregularCapitals[][2] = {
+    {0x181, 0x253}, {0x182, 0x183}, {0x184, 0x185}, {0x186, 0x254}, {0x187, 0x188}, {0x189, 0x256},
+    {0x18a, 0x257}, {0x18b, 0x18c}, {0x18e, 0x1dd}, {0x18f, 0x259}, {0x190, 0x25b}, {0x191, 0x192},
+    {0x193, 0x260}, {0x194, 0x263}, {0x196, 0x269}, {0x197, 0x268}, {0x198, 0x199}, {0x19c, 0x26f},
+    {0x19d, 0x272}, {0x19f, 0x275}, {0x1a2, 0x1a3}, {0x1a4, 0x1a5}, {0x1a6, 0x280}, {0x1a7, 0x1a8},
+    {0x1a9, 0x283}, {0x1ac, 0x1ad}, {0x1ae, 0x288}, {0x1b1, 0x28a}, {0x1b2, 0x28b}, {0x1b3, 0x1b4},
+    {0x1b5, 0x1b6}, {0x1b7, 0x292}, {0x1b8, 0x1b9}, {0x1bc, 0x1bd}, {0x1c4, 0x1c6}, {0x1c5, 0x1c6},
+    {0x1c7, 0x1c9}, {0x1c8, 0x1c9}, {0x1ca, 0x1cc}, {0x1cb, 0x1cc}, {0x1f1, 0x1f3}, {0x1f2, 0x1f3},
+    {0x1f4, 0x1f5}, {0x1f6, 0x195}, {0x1f7, 0x1bf}, {0x220, 0x19e}, {0x222, 0x223}, {0x224, 0x225},
+    {0x226, 0x227}, {0x228, 0x229}, {0x22a, 0x22b}, {0x22c, 0x22d}, {0x22e, 0x22f}, {0x230, 0x231},
+    {0x232, 0x233}, {0x23a, 0x2c65}, {0x23b, 0x23c}, {0x23d, 0x19a}, {0x23e, 0x2c66}, {0x241, 0x242},
+    {0x243, 0x180}, {0x244, 0x289}, {0x245, 0x28c}, {0x246, 0x247}, {0x248, 0x249}, {0x24a, 0x24b},
+    {0x24c, 0x24d}, {0x24e, 0x24f}, {0x3cf, 0x3d7}, {0x3f4, 0x3b8}, {0x3f7, 0x3f8}, {0x3f9, 0x3f2},
+    {0x3fa, 0x3fb}, {0x3fd, 0x37b}, {0x3fe, 0x37c}, {0x3ff, 0x37d}
+};
+
+#define IRREGULAR_CAPITAL_COUNT (sizeof(irregularCapitals) / sizeof(irregularCapitals[0]))
+
+unsigned int unicodeToLower(unsigned int c)
+{
+    if (c < 0x80)
+        return tolower(c);
+    if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+        return c + 0x20;
+    if (c == 0x178)
+        return 0xff;
+    if (c == 0x130)
+        return 'i';
+    /* Latin Extended-A pairs upper/lower case on even/odd code points,
+     * shifted by one between U+0139 and U+0148 and after U+0178 */
+    if ((c >= 0x100 && c <= 0x137) || (c >= 0x14a && c <= 0x177))
+        return c % 2 == 0 ? c + 1 : c;
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e))
+        return c % 2 == 1 ? c + 1 : c;
+    if (c == 0x1a0 || c == 0x1af)
+        return c + 1;
+    if ((c >= 0x1cd && c <= 0x1dc) && c % 2 == 1)
+        return c + 1;
+    if ((c >= 0x1de && c <= 0x1ef) && c % 2 == 0)
+        return c + 1;
+    if ((c >= 0x1f8 && c <= 0x21f) && c % 2 == 0)
+        return c + 1;
+    if ((c >= 0x3d8 && c <= 0x3ef) && c % 2 == 0)
+        return c + 1;
+    if ((c >= 0x180 && c <= 0x24f) || (c >= 0x3cf && c <= 0x3ff))
+    {
+        for (unsigned int i = 0; i < IRREGULAR_CAPITAL_COUNT && irregularCapitals[i][0] <= c; i++)
+            if (irregularCapitals[i][0] == c)
+                return irregularCapitals[i][1];
+        return c;
+    }
+    if (c == 0x386)
+        return 0x3ac;
+    if (c >= 0x388 && c <= 0x38a)
+        return c + 0x25;
+    if (c == 0x38c)
+        return 0x3cc;
+    if (c == 0x38e || c == 0x38f)
+        return c + 0x3f;
+    if (c >= 0x391 && c <= 0x3ab && c != 0x3a2)
+        return c + 0x20;
+    if (c >= 0x400 && c <= 0x40f)
+        return c + 0x50;
+    if (c >= 0x410 && c <= 0x42f)
+        return c + 0x20;
+    /* the palochka's lower case is at the end of the block, not next to it */
+    if (c == 0x4c0)
+        return 0x4cf;
+    if (c >= 0x460 && c <= 0x4ff && c != 0x482 && (c < 0x483 || c > 0x489) && c % 2 == 0)
+        return c >= 0x4c1 && c <= 0x4ce ? c : c + 1;
+    if (c >= 0x4c1 && c <= 0x4cd && c % 2 == 1)
+        return c + 1;
+    if (c == 0x1e9e)
+        return 0xdf;
+    if (c >= 0x1e00 && c <= 0x1eff && (c < 0x1e96 || c > 0x1e9f) && c % 2 == 0)
+        return c + 1;
+    return c;
+}
+
+/* Lower-cases a UTF-8 word into folded and returns the folded length,
+ * which is never longer than len. Malformed bytes are copied as they
+ * are. */
+int foldUtf8(const char *word, int len, char *folded)
+{
+    const unsigned char *p = (const unsigned char *)word;
+    const unsigned char *end = p + len;
+    int out = 0;
+    while (p < end)
+    {
+        if (*p < 0x80)
+        {
+            folded[out++] = tolower(*p++);
+            continue;
+        }
+        unsigned int codePoint;
+        int n = decodeUtf8(p, end, &codePoint);
+        if (n == 0)
+        {
+            folded[out++] = *p++;
+            continue;
+        }
+        unsigned int lower = unicodeToLower(codePoint);
+        char encoded[4];
+        int m = encodeUtf8(lower, encoded);
+        if (m > n)
+        {
+            m = n;
+            encodeUtf8(codePoint, encoded);
+        }
+        for (int i = 0; i < m; i++)
+            folded[out++] = encoded[i];
+        p += n;
+    }
+    folded[out] = '\0';
+    return out;
+}
+
+/* Byte order marks decide; without one, a text whose sampled odd (even)
+ * bytes are mostly zero is taken as UTF-16LE (BE), anything else as
+ * UTF-8. */
+int detectEncoding(const unsigned char *data, long size)
+{
+    if (size >= 2 && data[0] == 0xff && data[1] == 0xfe)
+        return ENCODING_UTF16LE;
+    if (size >= 2 && data[0] == 0xfe && data[1] == 0xff)
+        return ENCODING_UTF16BE;
+    if (size >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf)
+        return ENCODING_UTF8;
+
+    long sample = size < DETECT_SAMPLE_SIZE ? size & ~1L : DETECT_SAMPLE_SIZE;
+    long evenZeros = 0, oddZeros = 0;
+    for (long i = 0; i < sample; i += 2)
+    {
+        evenZeros += data[i] == 0;
+        oddZeros += data[i + 1] == 0;
+    }
+    if (sample > 0 && oddZeros * 4 > sample && evenZeros * 8 < sample)
+        return ENCODING_UTF16LE;
+    if (sample > 0 && evenZeros * 4 > sample && oddZeros * 8 < sample)
+        return ENCODING_UTF16BE;
+    return ENCODING_UTF8;
+}
+
+/* Transcodes UTF-16 to UTF-8. out needs room for size / 2 * 3 bytes. A
+ * byte order mark is skipped and unpaired surrogates are dropped.
+ * Returns the number of bytes written. */
+long utf16ToUtf8(const unsigned char *in, long size, int encoding, char *out)
+{
+    int bigEndian = encoding == ENCODING_UTF16BE;
+    long units = size / 2;
+    long i = 0;
+    char *start = out;
+    while (i < units)
+    {
+#ifdef __SSE2__
+        /* eight ASCII code units at a time narrow to eight bytes */
+        while (units - i >= 8)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+            if (bigEndian)
+                block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+            __m128i high = _mm_and_si128(block, _mm_set1_epi16((short)0xff80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xffff)
+                break;
+            _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(block, block));
+            out += 8;
+            i += 8;
+        }
+        if (i >= units)
+            break;
+#endif
+        unsigned int unit = bigEndian ? (in[2 * i] << 8) | in[2 * i + 1] : in[2 * i] | (in[2 * i + 1] << 8);
+        i++;
+        if (unit == 0xfeff && i == 1)
+            continue;
+        if (unit >= 0xd800 && unit <= 0xdbff && i < units)
+        {
+            unsigned int low = bigEndian ? (in[2 * i] << 8) | in[2 * i + 1] : in[2 * i] | (in[2 * i + 1] << 8);
+            if (low >= 0xdc00 && low <= 0xdfff)
+            {
+                i++;
+                out += encodeUtf8(0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00), out);
+            }
+            continue;
+        }
+        if (unit >= 0xd800 && unit <= 0xdfff)
+            continue;
+        out += encodeUtf8(unit, out);
+    }
+    return out - start;
+}
@@ -0,0 +1,20 @@
+#ifndef __UNICODE_H__
+#define __UNICODE_H__
+
+#include "tokenizer.h"
+
+#define ENCODING_UTF8 0
+#define ENCODING_UTF16LE 1
+#define ENCODING_UTF16BE 2
+
+int decodeUtf8(const unsigned char *p, const unsigned char *end, unsigned int *codePoint);
+int encodeUtf8(unsigned int codePoint, char *out);
+
+CharClass unicodeClass(unsigned int codePoint);
+unsigned int unicodeToLower(unsigned int codePoint);
+int foldUtf8(const char *word, int len, char *folded);
+
+int detectEncoding(const unsigned char *data, long size);
+long utf16ToUtf8(const unsigned char *in, long size, int encoding, char *out);
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "update.h"
+#include "store.h"
+#include "sort.h"
+
+/* What happens to one document of the updated index: the first keepRows
+ * of its old rows are kept, and suffix holds the rows read from the
+ * grown part of the file. */
+struct DocUpdate_
+{
+    char *name;
+    unsigned long long bytes;
+    unsigned long long completeBytes;
+    unsigned int oldFirstRow;
+    int keepRows;
+    unsigned int newFirstRow;
+    int newRows;
+    Index suffix;
+};
+
+typedef struct DocUpdate_ DocUpdate;
+
+/* Indexes whatever was appended to the document since it was last
+ * indexed. A partial last row is dropped and read again in full; a file
+ * that shrank is read again from the start. Returns IO_ERROR if the file
+ * cannot be read, in which case the old rows are kept as they are. */
+static int refreshDocument(DocUpdate *doc, Dict *stopWords, int threads)
+{
+    initIndex(&doc->suffix);
+    doc->newRows = doc->keepRows;
+
+    InputBuffer input;
+    if (openTextInput(doc->name, &input) == IO_ERROR)
+        return IO_ERROR;
+
+    unsigned long long size = input.size;
+    unsigned long long resume;
+    if (size == doc->bytes)
+    {
+        closeInput(&input);
+        return IO_SUCCESS;
+    }
+    if (size < doc->bytes)
+    {
+        doc->keepRows = 0;
+        doc->completeBytes = 0;
+        resume = 0;
+    }
+    else if (doc->completeBytes < doc->bytes)
+    {
+        doc->keepRows--;
+        resume = doc->completeBytes;
+    }
+    else
+        resume = doc->bytes;
+
+    indexTextParallel(&doc->suffix, stopWords, input.data + resume, size - resume, threads);
+    long completeBytes = completeLinesSize(input.data + resume, size - resume);
+    if (completeBytes > 0)
+        doc->completeBytes = resume + completeBytes;
+    doc->bytes = size;
+    doc->newRows = doc->keepRows + doc->suffix.rowCount;
+    closeInput(&input);
+    return IO_SUCCESS;
+}
+
+/* Merges two (row, col) ordered lists into out. */
+static int mergePostings(Posting *a, int aCount, Posting *b, int bCount, Posting *out)
+{
+    int i = 0, j = 0, k = 0;
+    while (i < aCount && j < bCount)
+        out[k++] = a[i] <= b[j] ? a[i++] : b[j++];
+    while (i < aCount)
+        out[k++] = a[i++];
+    while (j < bCount)
+        out[k++] = b[j++];
+    return k;
+}
+
+/* Brings an index file up to date with its documents and adds the files
+ * in paths that it does not cover yet. Only appended text and new files
+ * are tokenized; the old postings are renumbered and merged with the new
+ * ones and the file is replaced atomically. Documents are assumed to be
+ * append-only: a change inside the already indexed part goes unnoticed
+ * unless the file also got shorter. */
+int updateIndexFile(char *indexPath, char **paths, int pathCount, Dict *stopWords, int threads)
+{
+    StoredIndex stored;
+    if (openIndexFile(indexPath, &stored) == IO_ERROR)
+        return IO_ERROR;
+
+    int oldDocCount = stored.header->docCount;
+    DocUpdate *docs = calloc(oldDocCount + pathCount, sizeof(DocUpdate));
+    int docCount = 0;
+    Dict known;
+    initDict(&known);
+    for (int d = 0; d < oldDocCount; d++)
+    {
+        DocUpdate *doc = &docs[docCount++];
+        unsigned int nextFirstRow = d + 1 < oldDocCount ? stored.docFirstRows[d + 1] : stored.header->rowCount + 1;
+        doc->name = stored.names + stored.docNameOffsets[d];
+        doc->bytes = stored.docBytes[d];
+        doc->completeBytes = stored.docCompleteBytes[d];
+        doc->oldFirstRow = stored.docFirstRows[d];
+        doc->keepRows = nextFirstRow - doc->oldFirstRow;
+        if (refreshDocument(doc, stopWords, threads) == IO_ERROR)
+            printf("Cannot open file %s, keeping its old rows\n", doc->name);
+        dictInsert(&known, doc->name, strlen(doc->name), NULL);
+    }
+    for (int p = 0; p < pathCount; p++)
+    {
+        int isNew;
+        dictInsert(&known, paths[p], strlen(paths[p]), &isNew);
+        if (!isNew)
+            continue;
+        DocUpdate *doc = &docs[docCount];
+        memset(doc, 0, sizeof(DocUpdate));
+        doc->name = paths[p];
+        if (refreshDocument(doc, stopWords, threads) == IO_ERROR)
+        {
+            printf("Cannot open file %s\n", paths[p]);
+            freeIndex(&doc->suffix);
+            continue;
+        }
+        docCount++;
+    }
+    freeDict(&known);
+
+    /* lay the documents out again and gather all new rows in one index */
+    Index updated, delta;
+    initIndex(&updated);
+    initIndex(&delta);
+    unsigned int firstRow = 1;
+    for (int d = 0; d < docCount; d++)
+    {
+        DocUpdate *doc = &docs[d];
+        doc->newFirstRow = firstRow;
+        updated.rowCount = firstRow - 1;
+        addDocument(&updated, doc->name, doc->bytes, doc->completeBytes);
+        mergeIndex(&delta, &doc->suffix, firstRow + doc->keepRows - 1);
+        freeIndex(&doc->suffix);
+        firstRow += doc->newRows;
+    }
+    updated.rowCount = firstRow - 1;
+
+    /* old terms, in their sorted order, with renumbered rows */
+    int maxCount = 0;
+    for (unsigned int t = 0; t < stored.header->wordCount; t++)
+        if ((int)stored.terms[t].postingCount > maxCount)
+            maxCount = stored.terms[t].postingCount;
+    for (int i = 0; i < delta.dict.count; i++)
+        if (delta.postings[i].length > maxCount)
+            maxCount = delta.postings[i].length;
+    Posting *old = malloc((maxCount + 1) * sizeof(Posting));
+    Posting *merged = malloc((2 * maxCount + 1) * sizeof(Posting));
+
+    for (unsigned int t = 0; t < stored.header->wordCount; t++)
+    {
+        TermEntry *entry = &stored.terms[t];
+        readTermPostings(&stored, t, old);
+        int count = 0, d = 0;
+        for (unsigned int j = 0; j < entry->postingCount; j++)
+        {
+            unsigned int row = postingRow(old[j]);
+            while (d + 1 < oldDocCount && docs[d + 1].oldFirstRow <= row)
+                d++;
+            unsigned int line = row - docs[d].oldFirstRow;
+            if ((int)line < docs[d].keepRows)
+                old[count++] = makePosting(docs[d].newFirstRow + line, postingCol(old[j]));
+        }
+
+        char *key = stored.keys + entry->keyOffset;
+        int type = entry->type;
+        Posting *postings = old;
+        int deltaIndex = dictFind(&delta.dict, key, entry->keyLength);
+        if (deltaIndex >= 0)
+        {
+            PostingList *added = &delta.postings[deltaIndex];
+            if (count == 0 || added->items[added->length - 1] > old[count - 1])
+                type = delta.types[deltaIndex];
+            count = mergePostings(old, count, added->items, added->length, merged);
+            postings = merged;
+        }
+        if (count > 0)
+            addPostings(&updated, key, entry->keyLength, postings, count, type);
+    }
+
+    /* words seen for the first time */
+    int oldWords = updated.dict.count;
+    for (int i = 0; i < delta.dict.count; i++)
+    {
+        if (dictFind(&updated.dict, delta.dict.keys[i], delta.dict.lengths[i]) >= 0)
+            continue;
+        addPostings(&updated, delta.dict.keys[i], delta.dict.lengths[i],
+                    delta.postings[i].items, delta.postings[i].length, delta.types[i]);
+    }
+    free(old);
+    free(merged);
+    freeIndex(&delta);
+
+    /* ids below oldWords are already sorted; sort the new ones and merge */
+    int wordCount = updated.dict.count;
+    int *added = malloc((wordCount - oldWords + 1) * sizeof(int));
+    for (int i = oldWords; i < wordCount; i++)
+        added[i - oldWords] = i;
+    sortWordIds(added, wordCount - oldWords, updated.dict.keys);
+    int *order = malloc((wordCount + 1) * sizeof(int));
+    int i = 0, j = 0, k = 0;
+    while (i < oldWords && j < wordCount - oldWords)
+    {
+        if (strcmp(updated.dict.keys[i], updated.dict.keys[added[j]]) < 0)
+            order[k++] = i++;
+        else
+            order[k++] = added[j++];
+    }
+    while (i < oldWords)
+        order[k++] = i++;
+    while (j < wordCount - oldWords)
+        order[k++] = added[j++];
+    free(added);
+
+    int status = writeIndexFile(indexPath, &updated, order);
+    closeIndexFile(&stored);
+    free(order);
+    free(docs);
+    freeIndex(&updated);
+    return status;
+}
@@ -0,0 +1,8 @@
+#ifndef __UPDATE_H__
+#define __UPDATE_H__
+
+#include "index.h"
+
+int updateIndexFile(char *indexPath, char **paths, int pathCount, Dict *stopWords, int threads);
+
+#endif
@@ -0,0 +1,769 @@
+/* Code search over KPL programs, see codesearch.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>
+
+#include "reader.h"
+#include "error.h"
+#include "scanner.h"
+#include "codesearch.h"
+
+/***************************************************************/
+
+static int isIndexed(TokenType tokenType)
+{
+  return tokenType == TK_IDENT || (tokenType >= KW_PROGRAM && tokenType <= KW_FLOAT);
+}
+
+void initNesting(Nesting *nesting)
+{
+  nesting->frames = (NestingFrame *)malloc(NESTING_INIT_CAPACITY * sizeof(NestingFrame));
+  nesting->capacity = NESTING_INIT_CAPACITY;
+  nesting->count = 0;
+  nesting->depth = 0;
+}
+
+static NestingFrame *topFrame(Nesting *nesting)
+{
+  return nesting->count > 0 ? &nesting->frames[nesting->count - 1] : NULL;
+}
+
+static void pushFrame(Nesting *nesting, TokenType kind)
+{
+  NestingFrame *frame;
+
+  if (nesting->count == nesting->capacity)
+  {
+    nesting->capacity *= 2;
+    nesting->frames = (NestingFrame *)realloc(nesting->frames, nesting->capacity * sizeof(NestingFrame));
+  }
+  frame = &nesting->frames[nesting->count++];
+  frame->kind = kind;
+  frame->name = NULL;
+  frame->phase = PHASE_HEADER;
+  frame->depth = nesting->depth;
+}
+
+static void popFrame(Nesting *nesting)
+{
+  free(nesting->frames[--nesting->count].name);
+}
+
+static int isSubprogram(NestingFrame *frame)
+{
+  return frame->kind == KW_PROCEDURE || frame->kind == KW_FUNCTION;
+}
+
+/* Ends the statements at the current BEGIN depth that a ; or an END
+ * finishes: all but the blocks still open and the subprograms. */
+static void endStatements(Nesting *nesting)
+{
+  NestingFrame *frame = topFrame(nesting);
+  while (frame != NULL && frame->depth == nesting->depth && frame->phase != PHASE_BLOCK && !isSubprogram(frame))
+  {
+    popFrame(nesting);
+    frame = topFrame(nesting);
+  }
+}
+
+/* Follows the statement structure through one token. A FOR or WHILE
+ * runs to the end of the statement after its DO, an IF to the end of
+ * the one after its THEN or, if there is one, its ELSE, and a body is a
+ * statement up to ; END or ELSE or a BEGIN ... END. A subprogram runs
+ * from its keyword to the END of its own BEGIN; the subprograms declared
+ * inside it come and go before that BEGIN. This is the scanner's view,
+ * with no parser behind it, so a malformed program only confuses the
+ * nesting of the statements around the error. */
+void updateNesting(Nesting *nesting, Token *token)
+{
+  NestingFrame *frame = topFrame(nesting);
+  while (frame != NULL && frame->phase == PHASE_DONE && token->tokenType != KW_ELSE)
+  {
+    popFrame(nesting);
+    frame = topFrame(nesting);
+  }
+  if (frame != NULL && frame->phase == PHASE_PENDING && token->tokenType != KW_BEGIN)
+    frame->phase = PHASE_SIMPLE;
+
+  switch (token->tokenType)
+  {
+  case KW_FOR:
+  case KW_WHILE:
+  case KW_IF:
+  case KW_PROCEDURE:
+  case KW_FUNCTION:
+    pushFrame(nesting, token->tokenType);
+    break;
+  case TK_IDENT:
+    if (frame != NULL && isSubprogram(frame) && frame->name == NULL)
+      frame->name = strdup(token->string);
+    break;
+  case KW_DO:
+  case KW_THEN:
+    if (frame != NULL && frame->phase == PHASE_HEADER && !isSubprogram(frame))
+      frame->phase = PHASE_PENDING;
+    break;
+  case KW_ELSE:
+    /* the nearest IF at this depth takes the ELSE, the statements in
+     * its THEN end */
+    while (frame != NULL && frame->depth == nesting->depth && frame->phase != PHASE_BLOCK &&
+           !isSubprogram(frame) && !(frame->kind == KW_IF && frame->phase != PHASE_HEADER))
+    {
+      popFrame(nesting);
+      frame = topFrame(nesting);
+    }
+    if (frame != NULL && frame->kind == KW_IF && frame->depth == nesting->depth)
+      frame->phase = PHASE_PENDING;
+    break;
+  case KW_BEGIN:
+    if (frame != NULL && frame->depth == nesting->depth &&
+        (frame->phase == PHASE_PENDING || (isSubprogram(frame) && frame->phase == PHASE_HEADER)))
+      frame->phase = PHASE_BLOCK;
+    nesting->depth++;
+    break;
+  case KW_END:
+    endStatements(nesting);
+    if (nesting->depth > 0)
+      nesting->depth--;
+    frame = topFrame(nesting);
+    if (frame != NULL && frame->phase == PHASE_BLOCK && frame->depth == nesting->depth)
+    {
+      if (frame->kind == KW_IF)
+        frame->phase = PHASE_DONE;
+      else
+        popFrame(nesting);
+    }
+    break;
+  case SB_SEMICOLON:
+    endStatements(nesting);
+    break;
+  default:
+    break;
+  }
+}
+
+static char *frameKeyword(TokenType kind)
+{
+  switch (kind)
+  {
+  case KW_FOR:
+    return "FOR";
+  case KW_WHILE:
+    return "WHILE";
+  case KW_IF:
+    return "IF";
+  case KW_PROCEDURE:
+    return "PROCEDURE";
+  default:
+    return "FUNCTION";
+  }
+}
+
+/* Whether the token just passed to updateNesting lies in a statement
+ * with the keyword context or in a subprogram named context. */
+int isInside(Nesting *nesting, char *context)
+{
+  int i;
+  for (i = 0; i < nesting->count; i++)
+  {
+    NestingFrame *frame = &nesting->frames[i];
+    if (strcmp(frameKeyword(frame->kind), context) == 0 ||
+        (frame->name != NULL && strcmp(frame->name, context) == 0))
+      return 1;
+  }
+  return 0;
+}
+
+void freeNesting(Nesting *nesting)
+{
+  while (nesting->count > 0)
+    popFrame(nesting);
+  free(nesting->frames);
+}
+
+typedef void (*TokenVisitor)(Token *token, Nesting *nesting, void *context);
+
+/* Scans the file at path, passing visit each identifier and keyword
+ * with the statements around it. A lexical error ends the scan of the
+ * file with a warning, keeping what came before it, and leaks the token
+ * being read, as error.h says. Returns IO_ERROR if the file cannot be
+ * read. */
+static int scanFile(char *path, TokenVisitor visit, void *context)
+{
+  jmp_buf recovery;
+  Nesting *nesting;
+
+  if (openInputStream(path) == IO_ERROR)
+    return IO_ERROR;
+  nesting = (Nesting *)malloc(sizeof(Nesting));
+  initNesting(nesting);
+  errorRecovery = &recovery;
+  if (setjmp(recovery) == 0)
+  {
+    Token *token = getToken();
+    while (token->tokenType != TK_EOF)
+    {
+      updateNesting(nesting, token);
+      if (isIndexed(token->tokenType))
+        visit(token, nesting, context);
+      free(token);
+      token = getToken();
+    }
+    free(token);
+  }
+  else
+    fprintf(stderr, "%s: %d-%d:%s\n", path, lastErrorLineNo, lastErrorColNo, errorMessage(lastError));
+  errorRecovery = NULL;
+  freeNesting(nesting);
+  free(nesting);
+  closeInputStream();
+  return IO_SUCCESS;
+}
+
+/***************************************************************/
+
+/* The distinct trigrams seen so far, in an open addressing hash table
+ * of their numbers. */
+typedef struct
+{
+  char **keys;
+  int count;
+  int capacity;
+  int *slots; /* gram number + 1, 0 when empty */
+  int slotCount;
+} GramTable;
+
+typedef struct
+{
+  GramTable grams;
+  char window[GRAM_TOKENS][MAX_IDENT_LEN + 1];
+  int seen;
+  int *fileGrams;
+  int fileGramCount;
+  int fileGramCapacity;
+  int *pairGrams; /* for every file, its distinct grams */
+  int *pairFiles;
+  int pairCount;
+  int pairCapacity;
+} IndexBuilder;
+
+static unsigned int hashKey(char *key)
+{
+  unsigned int hash = 2166136261u;
+  while (*key != '\0')
+    hash = (hash ^ (unsigned char)*key++) * 16777619u;
+  return hash;
+}
+
+static void growGramTable(GramTable *table)
+{
+  int i;
+  table->slotCount = table->slotCount == 0 ? 1024 : table->slotCount * 2;
+  free(table->slots);
+  table->slots = (int *)calloc(table->slotCount, sizeof(int));
+  for (i = 0; i < table->count; i++)
+  {
+    unsigned int slot = hashKey(table->keys[i]) & (table->slotCount - 1);
+    while (table->slots[slot] != 0)
+      slot = (slot + 1) & (table->slotCount - 1);
+    table->slots[slot] = i + 1;
+  }
+}
+
+static int internGram(GramTable *table, char *key)
+{
+  unsigned int slot;
+  if (2 * (table->count + 1) > table->slotCount)
+    growGramTable(table);
+  slot = hashKey(key) & (table->slotCount - 1);
+  while (table->slots[slot] != 0)
+  {
+    if (strcmp(table->keys[table->slots[slot] - 1], key) == 0)
+      return table->slots[slot] - 1;
+    slot = (slot + 1) & (table->slotCount - 1);
+  }
+  if (table->count == table->capacity)
+  {
+    table->capacity = table->capacity == 0 ? 1024 : table->capacity * 2;
+    table->keys = (char **)realloc(table->keys, table->capacity * sizeof(char *));
+  }
+  table->keys[table->count] = strdup(key);
+  table->slots[slot] = table->count + 1;
+  return table->count++;
+}
+
+/* Moves the window of the last GRAM_TOKENS tokens on by word and, once
+ * it is full, records the trigram it holds for the file. */
+static void addGramToken(IndexBuilder *builder, char *word)
+{
+  char key[GRAM_TOKENS * (MAX_IDENT_LEN + 1)];
+  int i;
+  for (i = 0; i + 1 < GRAM_TOKENS; i++)
+    strcpy(builder->window[i], builder->window[i + 1]);
+  strcpy(builder->window[GRAM_TOKENS - 1], word);
+  if (++builder->seen < GRAM_TOKENS)
+    return;
+  strcpy(key, builder->window[0]);
+  for (i = 1; i < GRAM_TOKENS; i++)
+  {
+    strcat(key, " ");
+    strcat(key, builder->window[i]);
+  }
+  if (builder->fileGramCount == builder->fileGramCapacity)
+  {
+    builder->fileGramCapacity = builder->fileGramCapacity == 0 ? 256 : builder->fileGramCapacity * 2;
+    builder->fileGrams = (int *)realloc(builder->fileGrams, builder->fileGramCapacity * sizeof(int));
+  }
+  builder->fileGrams[builder->fileGramCount++] = internGram(&builder->grams, key);
+}
+
+static void visitForIndex(Token *token, Nesting *nesting, void *context)
+{
+  addGramToken((IndexBuilder *)context, token->string);
+}
+
+static int compareInts(const void *a, const void *b)
+{
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+static char **sortedKeys;
+
+static int compareGramNumbers(const void *a, const void *b)
+{
+  return strcmp(sortedKeys[*(const int *)a], sortedKeys[*(const int *)b]);
+}
+
+/* Indexes the pathCount files of paths into a new index file:
+ *   magic, int fileCount, int gramCount, int postingCount
+ *   int[gramCount + 1]   where the files of each gram start
+ *   int[postingCount]    file numbers
+ *   file names and then grams, each NUL terminated
+ * with the grams in strcmp order. Files that cannot be read are left
+ * out with a warning. */
+int buildCodeIndex(char **paths, int pathCount, char *indexPath)
+{
+  IndexBuilder *builder = (IndexBuilder *)calloc(1, sizeof(IndexBuilder));
+  char **files = (char **)malloc((pathCount + 1) * sizeof(char *));
+  int fileCount = 0, gramCount, ok = 0;
+  int *order, *ranks, *starts, *postings;
+  int i, j, f;
+  FILE *out;
+
+  for (f = 0; f < pathCount; f++)
+  {
+    builder->seen = 0;
+    builder->fileGramCount = 0;
+    if (scanFile(paths[f], visitForIndex, builder) == IO_ERROR)
+    {
+      fprintf(stderr, "%s: cannot read\n", paths[f]);
+      continue;
+    }
+    if (builder->seen > 0)
+      for (i = 1; i < GRAM_TOKENS; i++)
+        addGramToken(builder, GRAM_END);
+    qsort(builder->fileGrams, builder->fileGramCount, sizeof(int), compareInts);
+    for (i = 0; i < builder->fileGramCount; i++)
+    {
+      if (i > 0 && builder->fileGrams[i] == builder->fileGrams[i - 1])
+        continue;
+      if (builder->pairCount == builder->pairCapacity)
+      {
+        builder->pairCapacity = builder->pairCapacity == 0 ? 4096 : builder->pairCapacity * 2;
+        builder->pairGrams = (int *)realloc(builder->pairGrams, builder->pairCapacity * sizeof(int));
+        builder->pairFiles = (int *)realloc(builder->pairFiles, builder->pairCapacity * sizeof(int));
+      }
+      builder->pairGrams[builder->pairCount] = builder->fileGrams[i];
+      builder->pairFiles[builder->pairCount++] = fileCount;
+    }
+    files[fileCount++] = paths[f];
+  }
+
+  /* grams in key order, and their files counted out into place */
+  gramCount = builder->grams.count;
+  order = (int *)malloc((gramCount + 1) * sizeof(int));
+  ranks = (int *)malloc((gramCount + 1) * sizeof(int));
+  starts = (int *)calloc(gramCount + 2, sizeof(int));
+  postings = (int *)malloc((builder->pairCount + 1) * sizeof(int));
+  for (i = 0; i < gramCount; i++)
+    order[i] = i;
+  sortedKeys = builder->grams.keys;
+  qsort(order, gramCount, sizeof(int), compareGramNumbers);
+  for (i = 0; i < gramCount; i++)
+    ranks[order[i]] = i;
+  for (i = 0; i < builder->pairCount; i++)
+    starts[ranks[builder->pairGrams[i]] + 1]++;
+  for (i = 0; i < gramCount; i++)
+    starts[i + 1] += starts[i];
+  for (i = 0; i < builder->pairCount; i++)
+    postings[starts[ranks[builder->pairGrams[i]]]++] = builder->pairFiles[i];
+  for (i = gramCount; i > 0; i--)
+    starts[i] = starts[i - 1];
+  starts[0] = 0;
+
+  out = fopen(indexPath, "wb");
+  if (out != NULL)
+  {
+    int counts[3] = {fileCount, gramCount, builder->pairCount};
+    fwrite(CODE_INDEX_MAGIC, 1, strlen(CODE_INDEX_MAGIC), out);
+    fwrite(counts, sizeof(int), 3, out);
+    fwrite(starts, sizeof(int), gramCount + 1, out);
+    fwrite(postings, sizeof(int), builder->pairCount, out);
+    for (i = 0; i < fileCount; i++)
+      fwrite(files[i], 1, strlen(files[i]) + 1, out);
+    for (i = 0; i < gramCount; i++)
+    {
+      char *key = builder->grams.keys[order[i]];
+      fwrite(key, 1, strlen(key) + 1, out);
+    }
+    ok = !ferror(out);
+    ok &= fclose(out) == 0;
+  }
+
+  for (j = 0; j < gramCount; j++)
+    free(builder->grams.keys[j]);
+  free(builder->grams.keys);
+  free(builder->grams.slots);
+  free(builder->fileGrams);
+  free(builder->pairGrams);
+  free(builder->pairFiles);
+  free(builder);
+  free(files);
+  free(order);
+  free(ranks);
+  free(starts);
+  free(postings);
+  return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+/* Reads a whole index file made by buildCodeIndex. Returns IO_ERROR if
+ * it cannot be read or is not laid out as buildCodeIndex leaves it, so
+ * that searches never look past its lists. */
+int openCodeIndex(char *indexPath, CodeIndex *index)
+{
+  FILE *in = fopen(indexPath, "rb");
+  long size;
+  int counts[3], magicLength = strlen(CODE_INDEX_MAGIC);
+  int i, j, ok;
+  char *p, *end;
+
+  if (in == NULL)
+    return IO_ERROR;
+  fseek(in, 0, SEEK_END);
+  size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  index->data = (char *)malloc(size + 1);
+  if (size < magicLength + (long)sizeof(counts) || fread(index->data, 1, size, in) != (size_t)size ||
+      memcmp(index->data, CODE_INDEX_MAGIC, magicLength) != 0)
+  {
+    fclose(in);
+    free(index->data);
+    return IO_ERROR;
+  }
+  fclose(in);
+  index->data[size] = '\0';
+  memcpy(counts, index->data + magicLength, sizeof(counts));
+  index->fileCount = counts[0];
+  index->gramCount = counts[1];
+  p = index->data + magicLength + sizeof(counts);
+  end = index->data + size;
+  if (counts[0] < 0 || counts[1] < 0 || counts[2] < 0 ||
+      (end - p) / sizeof(int) < (size_t)counts[1] + 1 + counts[2])
+  {
+    free(index->data);
+    return IO_ERROR;
+  }
+  index->postingStarts = (int *)p;
+  index->postings = index->postingStarts + counts[1] + 1;
+  p = (char *)(index->postings + counts[2]);
+
+  /* the file lists of the grams follow one another, each of them file
+   * numbers in increasing order, so none is longer than the files */
+  ok = index->postingStarts[0] == 0 && index->postingStarts[index->gramCount] == counts[2];
+  for (i = 0; ok && i < index->gramCount; i++)
+  {
+    ok = index->postingStarts[i] <= index->postingStarts[i + 1];
+    for (j = index->postingStarts[i]; ok && j < index->postingStarts[i + 1]; j++)
+      ok = index->postings[j] >= 0 && index->postings[j] < index->fileCount &&
+           (j == index->postingStarts[i] || index->postings[j - 1] < index->postings[j]);
+  }
+  if (!ok)
+  {
+    free(index->data);
+    return IO_ERROR;
+  }
+
+  index->files = (char **)malloc((index->fileCount + 1) * sizeof(char *));
+  index->grams = (char **)malloc((index->gramCount + 1) * sizeof(char *));
+  for (i = 0; i < index->fileCount + index->gramCount; i++)
+  {
+    if (p >= end)
+    {
+      closeCodeIndex(index);
+      return IO_ERROR;
+    }
+    if (i < index->fileCount)
+      index->files[i] = p;
+    else
+      index->grams[i - index->fileCount] = p;
+    p += strlen(p) + 1;
+  }
+  return IO_SUCCESS;
+}
+
+void closeCodeIndex(CodeIndex *index)
+{
+  free(index->files);
+  free(index->grams);
+  free(index->data);
+}
+
+/***************************************************************/
+
+/* The first gram not below key. */
+static int lowerGram(CodeIndex *index, char *key)
+{
+  int low = 0, high = index->gramCount;
+  while (low < high)
+  {
+    int mid = low + (high - low) / 2;
+    if (strcmp(index->grams[mid], key) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/* Keeps in files, count of them, those also in the count2 of files2, both
+ * increasing, and returns how many are left. */
+static int intersectFiles(int *files, int count, int *files2, int count2)
+{
+  int i = 0, j = 0, kept = 0;
+  while (i < count && j < count2)
+  {
+    if (files[i] < files2[j])
+      i++;
+    else if (files2[j] < files[i])
+      j++;
+    else
+    {
+      files[kept++] = files[i];
+      i++;
+      j++;
+    }
+  }
+  return kept;
+}
+
+/* Stores in files the files holding the tokens in sequence, in order,
+ * and returns how many there are: for three tokens or more those in the
+ * lists of all its trigrams, shortest list first, and for fewer those of
+ * all the trigrams the tokens start. */
+static int sequenceFiles(CodeIndex *index, char **tokens, int count, int *files)
+{
+  char key[GRAM_TOKENS * (MAX_IDENT_LEN + 1) + 1];
+  int i, j, found, gramCount, shortest;
+  int *grams;
+
+  if (count < GRAM_TOKENS)
+  {
+    char *seen = (char *)calloc(index->fileCount + 1, 1);
+    int first, last;
+    strcpy(key, tokens[0]);
+    for (i = 1; i < count; i++)
+    {
+      strcat(key, " ");
+      strcat(key, tokens[i]);
+    }
+    strcat(key, " ");
+    first = lowerGram(index, key);
+    key[strlen(key) - 1] = ' ' + 1;
+    last = lowerGram(index, key);
+    for (i = first; i < last; i++)
+      for (j = index->postingStarts[i]; j < index->postingStarts[i + 1]; j++)
+        seen[index->postings[j]] = 1;
+    found = 0;
+    for (i = 0; i < index->fileCount; i++)
+      if (seen[i])
+        files[found++] = i;
+    free(seen);
+    return found;
+  }
+
+  gramCount = count - GRAM_TOKENS + 1;
+  grams = (int *)malloc(gramCount * sizeof(int));
+  for (i = 0; i < gramCount; i++)
+  {
+    strcpy(key, tokens[i]);
+    for (j = 1; j < GRAM_TOKENS; j++)
+    {
+      strcat(key, " ");
+      strcat(key, tokens[i + j]);
+    }
+    grams[i] = lowerGram(index, key);
+    if (grams[i] == index->gramCount || strcmp(index->grams[grams[i]], key) != 0)
+    {
+      free(grams);
+      return 0;
+    }
+  }
+  shortest = 0;
+  for (i = 1; i < gramCount; i++)
+    if (index->postingStarts[grams[i] + 1] - index->postingStarts[grams[i]] <
+        index->postingStarts[grams[shortest] + 1] - index->postingStarts[grams[shortest]])
+      shortest = i;
+  found = index->postingStarts[grams[shortest] + 1] - index->postingStarts[grams[shortest]];
+  memcpy(files, index->postings + index->postingStarts[grams[shortest]], found * sizeof(int));
+  for (i = 0; i < gramCount && found > 0; i++)
+    if (i != shortest)
+      found = intersectFiles(files, found, index->postings + index->postingStarts[grams[i]],
+                             index->postingStarts[grams[i] + 1] - index->postingStarts[grams[i]]);
+  free(grams);
+  return found;
+}
+
+typedef struct
+{
+  char **tokens;
+  int count;
+  char *context; /* for INSIDE, NULL for a sequence */
+  char (*window)[MAX_IDENT_LEN + 1];
+  int *windowLines;
+  int seen;
+  int *lines;
+  int lineCount;
+  int lineCapacity;
+} Matcher;
+
+static void addLine(Matcher *matcher, int lineNo)
+{
+  if (matcher->lineCount > 0 && matcher->lines[matcher->lineCount - 1] == lineNo)
+    return;
+  if (matcher->lineCount == matcher->lineCapacity)
+  {
+    matcher->lineCapacity = matcher->lineCapacity == 0 ? 16 : matcher->lineCapacity * 2;
+    matcher->lines = (int *)realloc(matcher->lines, matcher->lineCapacity * sizeof(int));
+  }
+  matcher->lines[matcher->lineCount++] = lineNo;
+}
+
+/* Notes the line of each match: of the first token of the sequence, or
+ * of the identifier used inside the context. */
+static void visitForMatch(Token *token, Nesting *nesting, void *context)
+{
+  Matcher *matcher = (Matcher *)context;
+  int i, slot;
+
+  if (matcher->context != NULL)
+  {
+    if (strcmp(token->string, matcher->tokens[0]) == 0 && isInside(nesting, matcher->context))
+      addLine(matcher, token->lineNo);
+    return;
+  }
+  slot = matcher->seen % matcher->count;
+  strcpy(matcher->window[slot], token->string);
+  matcher->windowLines[slot] = token->lineNo;
+  if (++matcher->seen < matcher->count)
+    return;
+  for (i = 0; i < matcher->count; i++)
+    if (strcmp(matcher->window[(matcher->seen + i) % matcher->count], matcher->tokens[i]) != 0)
+      return;
+  addLine(matcher, matcher->windowLines[matcher->seen % matcher->count]);
+}
+
+/* Answers one query: a sequence of identifiers and keywords, matched in
+ * order with only symbols, numbers and strings between them, or
+ * "X INSIDE K". Prints the lines of each file that matches, then how
+ * many files matched out of the candidates the index left. With scanAll
+ * every file is scanned instead, to check the index against. Returns
+ * IO_ERROR if the query is malformed. */
+int searchCode(CodeIndex *index, char *query, int scanAll)
+{
+  char *text = strdup(query);
+  char *tokens[MAX_QUERY_TOKENS];
+  int count = 0;
+  char *word, *p;
+  int i, candidates, matched;
+  int *files;
+  Matcher matcher;
+
+  for (word = strtok(text, " \t"); word != NULL; word = strtok(NULL, " \t"))
+  {
+    if (count == MAX_QUERY_TOKENS || strlen(word) > MAX_IDENT_LEN || !isalpha((unsigned char)word[0]))
+    {
+      free(text);
+      return IO_ERROR;
+    }
+    for (p = word; *p != '\0'; p++)
+    {
+      if (!isalnum((unsigned char)*p))
+      {
+        free(text);
+        return IO_ERROR;
+      }
+      *p = toupper((unsigned char)*p);
+    }
+    tokens[count++] = word;
+  }
+  memset(&matcher, 0, sizeof(matcher));
+  matcher.tokens = tokens;
+  matcher.count = count;
+  if (count == 3 && strcmp(tokens[1], INSIDE_OPERATOR) == 0)
+  {
+    matcher.count = 1;
+    matcher.context = tokens[2];
+  }
+  if (count == 0)
+  {
+    free(text);
+    return IO_ERROR;
+  }
+
+  files = (int *)malloc((index->fileCount + 1) * sizeof(int));
+  if (scanAll)
+  {
+    for (i = 0; i < index->fileCount; i++)
+      files[i] = i;
+    candidates = index->fileCount;
+  }
+  else if (matcher.context != NULL)
+  {
+    int *contextFiles = (int *)malloc((index->fileCount + 1) * sizeof(int));
+    candidates = sequenceFiles(index, tokens, 1, files);
+    candidates = intersectFiles(files, candidates, contextFiles, sequenceFiles(index, &tokens[2], 1, contextFiles));
+    free(contextFiles);
+  }
+  else
+    candidates = sequenceFiles(index, tokens, count, files);
+
+  matcher.window = malloc(matcher.count * sizeof(*matcher.window));
+  matcher.windowLines = (int *)malloc(matcher.count * sizeof(int));
+  matched = 0;
+  for (i = 0; i < candidates; i++)
+  {
+    int j;
+    matcher.seen = 0;
+    matcher.lineCount = 0;
+    scanFile(index->files[files[i]], visitForMatch, &matcher);
+    if (matcher.lineCount == 0)
+      continue;
+    matched++;
+    printf("%s:", index->files[files[i]]);
+    for (j = 0; j < matcher.lineCount; j++)
+      printf(" %d", matcher.lines[j]);
+    printf("\n");
+  }
+  printf("%s: %d files, %d candidates of %d\n", query, matched, candidates, index->fileCount);
+
+  free(matcher.window);
+  free(matcher.windowLines);
+  free(matcher.lines);
+  free(files);
+  free(text);
+  return IO_SUCCESS;
+}
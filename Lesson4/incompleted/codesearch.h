@@ -0,0 +1,80 @@
+/* Code search over KPL programs
+ *
+ * The index is built from the tokens the scanner reads, not from the
+ * bytes of the files: the identifiers and keywords of a program, in
+ * order, are cut into trigrams of three consecutive tokens, and each
+ * trigram lists the files it occurs in. A file's tokens end with two
+ * GRAM_END tokens, so every token starts a trigram and the trigrams that
+ * start with one or two tokens, a range of the sorted trigrams, give the
+ * files holding those. A query is answered by intersecting the lists of
+ * its trigrams and then scanning only the files left for the lines.
+ */
+
+#ifndef __CODESEARCH_H__
+#define __CODESEARCH_H__
+
+#include "token.h"
+
+#define CODE_INDEX_MAGIC "KPLCODE1"
+#define GRAM_TOKENS 3
+#define GRAM_END "$"
+
+#define MAX_QUERY_TOKENS 64
+#define NESTING_INIT_CAPACITY 16
+
+/* "X INSIDE K" finds X used inside a FOR, WHILE or IF statement for a K
+ * of that keyword, or inside a procedure or function named K, or any of
+ * them for PROCEDURE or FUNCTION. */
+#define INSIDE_OPERATOR "INSIDE"
+
+/* A statement or subprogram being scanned: its keyword, the name of a
+ * subprogram, how far it has got and the BEGIN depth it started at. */
+typedef enum
+{
+  PHASE_HEADER,  /* before DO or THEN, or the BEGIN of a subprogram */
+  PHASE_PENDING, /* before the statement of its body */
+  PHASE_SIMPLE,  /* in a body that ends at ; END or ELSE */
+  PHASE_BLOCK,   /* in a BEGIN ... END body */
+  PHASE_DONE     /* an IF whose body ended, which an ELSE may follow */
+} NestingPhase;
+
+typedef struct
+{
+  TokenType kind;
+  char *name;
+  NestingPhase phase;
+  int depth;
+} NestingFrame;
+
+/* The statements and subprograms around the token being scanned, as
+ * deep as the program nests them. */
+typedef struct
+{
+  NestingFrame *frames;
+  int count;
+  int capacity;
+  int depth;
+} Nesting;
+
+typedef struct
+{
+  char *data;
+  int fileCount;
+  int gramCount;
+  char **files;
+  char **grams;        /* sorted by strcmp */
+  int *postingStarts;  /* gramCount + 1 */
+  int *postings;       /* file numbers, increasing for each gram */
+} CodeIndex;
+
+void initNesting(Nesting *nesting);
+void updateNesting(Nesting *nesting, Token *token);
+int isInside(Nesting *nesting, char *context);
+void freeNesting(Nesting *nesting);
+
+int buildCodeIndex(char **paths, int pathCount, char *indexPath);
+int openCodeIndex(char *indexPath, CodeIndex *index);
+void closeCodeIndex(CodeIndex *index);
+int searchCode(CodeIndex *index, char *query, int scanAll);
+
+#endif
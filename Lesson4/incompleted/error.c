@@ -8,7 +8,7 @@
 #include <stdlib.h>
 #include "error.h"
 
-#define NUM_OF_ERRORS 100
+#define NUM_OF_ERRORS 34
 
 struct ErrorMessage
 {
@@ -16,7 +16,7 @@ struct ErrorMessage
   char *message;
 };
 
-struct ErrorMessage errors[35] = {
+struct ErrorMessage errors[NUM_OF_ERRORS] = {
     {ERR_END_OF_COMMENT, "End of comment expected."},
     {ERR_IDENT_TOO_LONG, "Identifier too long."},
     {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -53,9 +53,29 @@ struct ErrorMessage errors[35] = {
     {ERR_USE_FLOAT_FOR_STATEMENT, "Don't use floating point number in for statement"},
 };
 
+jmp_buf *errorRecovery = NULL;
+ErrorCode lastError;
+int lastErrorLineNo, lastErrorColNo;
+
+char *errorMessage(ErrorCode err)
+{
+  int i;
+  for (i = 0; i < NUM_OF_ERRORS; i++)
+    if (errors[i].errorCode == err)
+      return errors[i].message;
+  return "Unknown error.";
+}
+
 void error(ErrorCode err, int lineNo, int colNo)
 {
   int i;
+  if (errorRecovery != NULL)
+  {
+    lastError = err;
+    lastErrorLineNo = lineNo;
+    lastErrorColNo = colNo;
+    longjmp(*errorRecovery, 1);
+  }
   for (i = 0; i < NUM_OF_ERRORS; i++)
     if (errors[i].errorCode == err)
     {
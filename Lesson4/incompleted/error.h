@@ -6,6 +6,7 @@
 
 #ifndef __ERROR_H__
 #define __ERROR_H__
+#include <setjmp.h>
 #include "token.h"
 
 typedef enum
@@ -47,7 +48,17 @@ typedef enum
   ERR_USE_FLOAT_FOR_STATEMENT,
 } ErrorCode;
 
+/* When errorRecovery is set, error records the error in lastError,
+ * lastErrorLineNo and lastErrorColNo and jumps there instead of printing
+ * it and exiting, so that a tool scanning many files can go on. The
+ * token the scanner was reading when it found the error is not freed:
+ * one Token is lost for each recovery. */
+extern jmp_buf *errorRecovery;
+extern ErrorCode lastError;
+extern int lastErrorLineNo, lastErrorColNo;
+
 void error(ErrorCode err, int lineNo, int colNo);
+char *errorMessage(ErrorCode err);
 void missingToken(TokenType tokenType, int lineNo, int colNo);
 void assert(char *msg);
 
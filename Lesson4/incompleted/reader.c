@@ -5,29 +5,100 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "reader.h"
 
-FILE *inputStream;
+#define READ_CHUNK 65536
+
+unsigned char *inputPointer;
+unsigned char *inputEnd;
 int lineNo, colNo;
 int currentChar;
 
-int readChar(void)
+static unsigned char *inputBuffer;
+static size_t mappedLength; /* 0 if inputBuffer was allocated */
+
+/* Maps a regular file of size bytes followed by a page of zeros, the
+ * last of which is the sentinel: anonymous pages are reserved for both
+ * and the file is mapped over the first ones. */
+static int mapInput(int fd, size_t size)
 {
-  currentChar = getc(inputStream);
-  colNo++;
-  if (currentChar == '\n')
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t length = (size + 1 + page - 1) / page * page;
+  void *base = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return IO_ERROR;
+  if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
   {
-    lineNo++;
-    colNo = 0;
+    munmap(base, length);
+    return IO_ERROR;
   }
-  return currentChar;
+  madvise(base, size, MADV_SEQUENTIAL);
+  inputBuffer = base;
+  inputEnd = inputBuffer + size;
+  mappedLength = length;
+  return IO_SUCCESS;
+}
+
+/* Reads what cannot be mapped, such as a pipe, into a buffer that grows
+ * until the end, starting from sizeHint bytes. */
+static int readInput(int fd, size_t sizeHint)
+{
+  size_t capacity = sizeHint + 1 > READ_CHUNK ? sizeHint + 1 : READ_CHUNK;
+  size_t size = 0;
+  ssize_t n;
+  inputBuffer = malloc(capacity);
+  if (inputBuffer == NULL)
+    return IO_ERROR;
+  while ((n = read(fd, inputBuffer + size, capacity - 1 - size)) != 0)
+  {
+    if (n < 0)
+    {
+      free(inputBuffer);
+      return IO_ERROR;
+    }
+    size += n;
+    if (size == capacity - 1)
+    {
+      unsigned char *grown = realloc(inputBuffer, capacity * 2);
+      if (grown == NULL)
+      {
+        free(inputBuffer);
+        return IO_ERROR;
+      }
+      inputBuffer = grown;
+      capacity *= 2;
+    }
+  }
+  inputBuffer[size] = '\0';
+  inputEnd = inputBuffer + size;
+  mappedLength = 0;
+  return IO_SUCCESS;
 }
 
 int openInputStream(char *fileName)
 {
-  inputStream = fopen(fileName, "rt");
-  if (inputStream == NULL)
+  struct stat status;
+  int result;
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0)
+    return IO_ERROR;
+  if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+  {
+    result = mapInput(fd, status.st_size);
+    if (result == IO_ERROR)
+      result = readInput(fd, status.st_size);
+  }
+  else
+    result = readInput(fd, 0);
+  close(fd);
+  if (result == IO_ERROR)
     return IO_ERROR;
+  inputPointer = inputBuffer;
   lineNo = 1;
   colNo = 0;
   readChar();
@@ -36,5 +107,9 @@ int openInputStream(char *fileName)
 
 void closeInputStream()
 {
-  fclose(inputStream);
+  if (mappedLength > 0)
+    munmap(inputBuffer, mappedLength);
+  else
+    free(inputBuffer);
+  inputBuffer = inputPointer = inputEnd = NULL;
 }
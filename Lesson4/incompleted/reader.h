@@ -7,10 +7,38 @@
 #ifndef __READER_H__
 #define __READER_H__
 
+#include <stdio.h>
+
 #define IO_ERROR 0
 #define IO_SUCCESS 1
 
-int readChar(void);
+/* The whole source is in memory, mapped or read at once, and followed by
+ * a NUL; inputPointer is the next character and inputEnd the NUL. */
+extern unsigned char *inputPointer;
+extern unsigned char *inputEnd;
+extern int lineNo, colNo;
+extern int currentChar;
+
+/* Reading a character is a load and a pointer increment. Only a NUL has
+ * to be told apart from the end; at the end the pointer stays and
+ * currentChar is EOF, as getc would return. It is inlined even in the
+ * unoptimised build the Makefile makes. */
+static inline __attribute__((always_inline)) int readChar(void)
+{
+  currentChar = *inputPointer;
+  if (currentChar == '\0' && inputPointer == inputEnd)
+    currentChar = EOF;
+  else
+    inputPointer++;
+  colNo++;
+  if (currentChar == '\n')
+  {
+    lineNo++;
+    colNo = 0;
+  }
+  return currentChar;
+}
+
 int openInputStream(char *fileName);
 void closeInputStream(void);
 
@@ -0,0 +1,94 @@
+/* Code search over KPL programs: builds a token trigram index of a set
+ * of programs, or answers queries from one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+#include "codesearch.h"
+
+/******************************************************************/
+
+/* Reads the file names listed one to a line in fileName. */
+char **readFileList(char *fileName, int *count)
+{
+  FILE *list = fopen(fileName, "rt");
+  char line[4096];
+  char **paths = NULL;
+  int capacity = 0;
+
+  *count = 0;
+  if (list == NULL)
+    return NULL;
+  while (fgets(line, sizeof(line), list) != NULL)
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0')
+      continue;
+    if (*count == capacity)
+    {
+      capacity = capacity == 0 ? 256 : capacity * 2;
+      paths = (char **)realloc(paths, capacity * sizeof(char *));
+    }
+    paths[(*count)++] = strdup(line);
+  }
+  fclose(list);
+  return paths;
+}
+
+void usage(char *name)
+{
+  printf("Usage: %s -o index file.kpl...\n"
+         "       %s -o index -f filelist\n"
+         "       %s [-a] -q index query...\n"
+         "A query is a sequence of identifiers and keywords, or \"X inside K\" for X used\n"
+         "inside a FOR, WHILE or IF K or a procedure or function K.\n",
+         name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+  int scanAll;
+
+  if (argc >= 3 && strcmp(argv[1], "-o") == 0)
+  {
+    char **paths = argv + 3;
+    int count = argc - 3;
+    if (argc == 5 && strcmp(argv[3], "-f") == 0)
+    {
+      paths = readFileList(argv[4], &count);
+      if (paths == NULL)
+      {
+        printf("Cannot read file list!\n");
+        return -1;
+      }
+    }
+    if (buildCodeIndex(paths, count, argv[2]) == IO_ERROR)
+    {
+      printf("Cannot write index!\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  scanAll = argc >= 2 && strcmp(argv[1], "-a") == 0;
+  if (argc >= 4 + scanAll && strcmp(argv[1 + scanAll], "-q") == 0)
+  {
+    CodeIndex index;
+    int i;
+    if (openCodeIndex(argv[2 + scanAll], &index) == IO_ERROR)
+    {
+      printf("Cannot read index!\n");
+      return -1;
+    }
+    for (i = 3 + scanAll; i < argc; i++)
+      if (searchCode(&index, argv[i], scanAll) == IO_ERROR)
+        printf("%s: Bad query\n", argv[i]);
+    closeCodeIndex(&index);
+    return 0;
+  }
+
+  usage(argv[0]);
+  return -1;
+}